@@ -0,0 +1,529 @@
+// This program is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+
+#define _DARWIN_C_SOURCE
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 700
+#define _XOPEN_SOURCE_EXTENDED
+
+#include <assert.h>
+#include <dlfcn.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "autopilot.h"
+#include "game.h"
+#include "path.h"
+#include "robotfindskitten.h"
+
+static int GetDistance(int y0, int x0, int y1, int x1) {
+  const int dy = abs(y1 - y0);
+  const int dx = abs(x1 - x0);
+  return dy > dx ? dy : dx;
+}
+
+// Returns true if Robot can usefully step in direction `d`: the step stays
+// on the field and does not bump into an item Robot has already touched.
+// Bumping into an untouched item is useful, since that is how Robot finds
+// out what it is.
+static bool CanStep(const Autopilot* autopilot, const Game* game, Direction d,
+                    bool allow_backtrack) {
+  const Item* robot = &game->items[Robot];
+  const int y = robot->y + Steps[d].dy;
+  const int x = robot->x + Steps[d].dx;
+  const int width = GetItemWidth(robot);
+  if (y < FrameThickness || y >= game->height - FrameThickness ||
+      x < FrameThickness || x + width > game->width - FrameThickness) {
+    return false;
+  }
+  if (!allow_backtrack && y == autopilot->previous_y &&
+      x == autopilot->previous_x) {
+    return false;
+  }
+  // Like TouchTest, only the leftmost item the span covers counts.
+  for (int i = 0; i < width; ++i) {
+    const uint32_t occupant = GetOccupant(game, y, x + i);
+    if (occupant != 0 && occupant - 1 != Robot) {
+      return !IsTouched(game, occupant - 1);
+    }
+  }
+  return true;
+}
+
+static Direction Wander(Autopilot* autopilot, const Game* game) {
+  const int start = (int)RandomBelow(&autopilot->random, DirectionCount);
+  for (int i = 0; i < DirectionCount; ++i) {
+    const Direction d = (Direction)((start + i) % DirectionCount);
+    if (CanStep(autopilot, game, d, true)) {
+      return d;
+    }
+  }
+  return (Direction)start;
+}
+
+// Returns the direction that best heads Robot for row y, between min_x and
+// max_x: straight at the nearest of those cells if possible, or else the
+// smallest turn away from that.
+static Direction Navigate(Autopilot* autopilot, const Game* game, int y,
+                          int min_x, int max_x) {
+  const Item* robot = &game->items[Robot];
+  const int x = robot->x < min_x ? min_x : robot->x > max_x ? max_x : robot->x;
+  const int distance = GetDistance(robot->y, robot->x, y, x);
+  PathFinder* paths = &autopilot->paths;
+  if (y != autopilot->goal_y || min_x != autopilot->goal_min_x ||
+      max_x != autopilot->goal_max_x) {
+    autopilot->goal_y = y;
+    autopilot->goal_min_x = min_x;
+    autopilot->goal_max_x = max_x;
+    autopilot->best_distance = distance;
+    autopilot->stalled = 0;
+    autopilot->stranded = false;
+    paths->path_length = 0;
+  } else if (distance < autopilot->best_distance) {
+    autopilot->best_distance = distance;
+    autopilot->stalled = 0;
+  } else if (++autopilot->stalled > game->width + game->height) {
+    autopilot->stalled = 0;
+    autopilot->path_next = 0;
+    bool found = FindPath(paths, game, y, x);
+    for (int goal_x = min_x; !found && goal_x <= max_x; ++goal_x) {
+      found = goal_x != x && FindPath(paths, game, y, goal_x);
+    }
+    if (!found) {
+      autopilot->stranded = true;
+      autopilot->wandering = BlockSize;
+    }
+  }
+  while (autopilot->path_next < paths->path_length) {
+    const uint32_t target = paths->path[autopilot->path_next];
+    const int target_y = (int)(target / (uint32_t)game->width);
+    const int target_x = (int)(target % (uint32_t)game->width);
+    if (robot->y == target_y && robot->x == target_x) {
+      ++autopilot->path_next;
+      continue;
+    }
+    const Direction d =
+        GetDirection(target_y - robot->y, target_x - robot->x);
+    if (CanStep(autopilot, game, d, true)) {
+      return d;
+    }
+    // An item has wandered into the way.
+    paths->path_length = 0;
+    autopilot->wandering = BlockSize;
+  }
+  if (autopilot->wandering > 0) {
+    --autopilot->wandering;
+    return Wander(autopilot, game);
+  }
+
+  const Direction preferred = GetDirection(y - robot->y, x - robot->x);
+  static const int Turns[] = {0, 1, -1, 2, -2, 3, -3, 4};
+  for (int pass = 0; pass < 2; ++pass) {
+    for (size_t i = 0; i < COUNT(Turns); ++i) {
+      const Direction d =
+          (Direction)(((int)preferred + Turns[i] + DirectionCount) %
+                      DirectionCount);
+      if (CanStep(autopilot, game, d, pass == 1)) {
+        return d;
+      }
+    }
+  }
+  return preferred;
+}
+
+// Heads for the cell from which Robot touches the item: on its row, with the
+// spans of the two icons overlapping.
+static Direction NavigateToItem(Autopilot* autopilot, const Game* game,
+                                size_t item_number) {
+  int min_x = 0;
+  int max_x = 0;
+  GetTouchSpan(game, item_number, &min_x, &max_x);
+  return Navigate(autopilot, game, game->items[item_number].y, min_x, max_x);
+}
+
+// Returns the untouched item closest to Robot, searching outward from Robot's
+// block in rings of blocks, and skipping blocks whose items have all been
+// touched. An item in ring r is at least (r - 1) * BlockSize + 1 cells
+// away, which tells us when to stop. Items marked in `skip`, if it is not
+// NULL, do not count. Returns false if there are none left.
+static bool FindNearestItem(const Game* game, const bool* skip,
+                            size_t* item_number) {
+  const Item* robot = &game->items[Robot];
+  const int robot_row = robot->y >> BlockShift;
+  const int robot_column = robot->x >> BlockShift;
+  const int rings = game->block_rows > game->block_columns
+                        ? game->block_rows
+                        : game->block_columns;
+  int best_distance = INT32_MAX;
+  for (int ring = 0; ring < rings; ++ring) {
+    if ((ring - 1) * BlockSize + 1 > best_distance) {
+      break;
+    }
+    for (int row = robot_row - ring; row <= robot_row + ring; ++row) {
+      if (row < 0 || row >= game->block_rows) {
+        continue;
+      }
+      const bool edge = row == robot_row - ring || row == robot_row + ring;
+      const int step = edge ? 1 : 2 * ring;
+      for (int column = robot_column - ring; column <= robot_column + ring;
+           column += step > 0 ? step : 1) {
+        if (column < 0 || column >= game->block_columns) {
+          continue;
+        }
+        const size_t block =
+            (size_t)row * (size_t)game->block_columns + (size_t)column;
+        if (game->block_items[block] == game->block_touched[block]) {
+          continue;
+        }
+        const int max_y = (row + 1) * BlockSize < game->height
+                              ? (row + 1) * BlockSize
+                              : game->height;
+        const int max_x = (column + 1) * BlockSize < game->width
+                              ? (column + 1) * BlockSize
+                              : game->width;
+        for (int y = row * BlockSize; y < max_y; ++y) {
+          for (int x = column * BlockSize; x < max_x; ++x) {
+            const uint32_t occupant = GetOccupant(game, y, x);
+            if (occupant == 0 || occupant - 1 == Robot ||
+                IsTouched(game, occupant - 1) ||
+                (skip != NULL && skip[occupant - 1])) {
+              continue;
+            }
+            const Item* item = &game->items[occupant - 1];
+            if (item->x != x) {
+              // Not the item's first cell.
+              continue;
+            }
+            const int distance = GetDistance(robot->y, robot->x, y, x);
+            if (distance < best_distance) {
+              best_distance = distance;
+              *item_number = occupant - 1;
+            }
+          }
+        }
+      }
+    }
+  }
+  return best_distance != INT32_MAX;
+}
+
+// Gives up on the item Robot is heading for, when Navigate found no path to
+// it: other items and the frame wall it in.
+static void SkipTarget(Autopilot* autopilot, const Game* game) {
+  autopilot->stranded = false;
+  autopilot->has_target = false;
+  if (autopilot->unreachable == NULL) {
+    autopilot->unreachable = calloc(game->item_count, sizeof(bool));
+    if (autopilot->unreachable == NULL) {
+      return;
+    }
+  }
+  if (!autopilot->unreachable[autopilot->target]) {
+    autopilot->unreachable[autopilot->target] = true;
+    ++autopilot->unreachable_count;
+  }
+}
+
+// Forgets the items Robot gave up on, since items in the way may have moved
+// since. Returns false if there were none.
+static bool ForgetUnreachable(Autopilot* autopilot, const Game* game) {
+  if (autopilot->unreachable_count == 0) {
+    return false;
+  }
+  memset(autopilot->unreachable, 0, game->item_count * sizeof(bool));
+  autopilot->unreachable_count = 0;
+  return true;
+}
+
+static Direction DecideNearest(Autopilot* autopilot, const Game* game) {
+  if (autopilot->stranded) {
+    SkipTarget(autopilot, game);
+  }
+  if (!autopilot->has_target || IsTouched(game, autopilot->target)) {
+    autopilot->has_target =
+        FindNearestItem(game, autopilot->unreachable, &autopilot->target) ||
+        (ForgetUnreachable(autopilot, game) &&
+         FindNearestItem(game, NULL, &autopilot->target));
+    if (!autopilot->has_target) {
+      return Wander(autopilot, game);
+    }
+  }
+  return NavigateToItem(autopilot, game, autopilot->target);
+}
+
+// Finds the first item on the sweep row, going from Robot's column in the
+// given direction, that Robot has yet to touch and has not given up on.
+static bool FindRowItem(const Autopilot* autopilot, const Game* game,
+                        bool right, size_t* item_number) {
+  const int y = autopilot->sweep_row;
+  const int start = right ? game->items[Robot].x : game->items[Robot].x - 1;
+  const int end = right ? game->width - FrameThickness : FrameThickness - 1;
+  for (int x = start; x != end; x += right ? 1 : -1) {
+    const uint32_t occupant = GetOccupant(game, y, x);
+    if (occupant == 0 || occupant - 1 == Robot ||
+        IsTouched(game, occupant - 1) ||
+        (autopilot->unreachable != NULL &&
+         autopilot->unreachable[occupant - 1])) {
+      continue;
+    }
+    *item_number = occupant - 1;
+    return true;
+  }
+  return false;
+}
+
+// Sweeps the field a row at a time, back and forth, touching the items on
+// each row in turn. Robot may arrive at a row partway along, as when it wraps
+// around from the bottom to the top, so it first touches the items toward the
+// row's start. A row is done when it has no item left that Robot can reach.
+static Direction DecideSweep(Autopilot* autopilot, const Game* game) {
+  const Item* robot = &game->items[Robot];
+  if (autopilot->sweep_row == 0) {
+    autopilot->sweep_row = robot->y;
+    autopilot->sweep_right = robot->x < game->width / 2;
+  }
+  if (autopilot->stranded) {
+    SkipTarget(autopilot, game);
+  }
+  // Which item is first from Robot's column changes as Robot steps around
+  // obstacles, so Robot keeps to one until it touches it.
+  if (autopilot->has_target && !IsTouched(game, autopilot->target)) {
+    return NavigateToItem(autopilot, game, autopilot->target);
+  }
+  for (int pass = 0; pass < 2; ++pass) {
+    for (int row = FrameThickness; row < game->height - FrameThickness;) {
+      const bool right = autopilot->sweep_started == autopilot->sweep_right;
+      if (FindRowItem(autopilot, game, right, &autopilot->target)) {
+        autopilot->has_target = true;
+        return NavigateToItem(autopilot, game, autopilot->target);
+      }
+      if (!autopilot->sweep_started) {
+        autopilot->sweep_started = true;
+        continue;
+      }
+      ++autopilot->sweep_row;
+      if (autopilot->sweep_row >= game->height - FrameThickness) {
+        autopilot->sweep_row = FrameThickness;
+      }
+      autopilot->sweep_right = !autopilot->sweep_right;
+      autopilot->sweep_started = false;
+      ++row;
+    }
+    if (!ForgetUnreachable(autopilot, game)) {
+      break;
+    }
+  }
+  autopilot->has_target = false;
+  return Wander(autopilot, game);
+}
+
+static Direction DecideRandom(Autopilot* autopilot, const Game* game) {
+  return Wander(autopilot, game);
+}
+
+const Strategy Strategies[] = {
+    {"nearest", DecideNearest, NULL},
+    {"sweep", DecideSweep, NULL},
+    {"random", DecideRandom, NULL},
+};
+const size_t StrategyCount = COUNT(Strategies);
+
+const Strategy* FindStrategy(const char* name) {
+  for (size_t i = 0; i < StrategyCount; ++i) {
+    if (StringsEqual(name, Strategies[i].name)) {
+      return &Strategies[i];
+    }
+  }
+  return NULL;
+}
+
+void ResetAutopilot(Autopilot* autopilot, const Strategy* strategy,
+                    const Game* game) {
+  memset(autopilot, 0, sizeof(*autopilot));
+  autopilot->strategy = strategy;
+  autopilot->random.state = ~game->seed;
+  autopilot->y = autopilot->previous_y = game->items[Robot].y;
+  autopilot->x = autopilot->previous_x = game->items[Robot].x;
+  autopilot->best_distance = INT32_MAX;
+}
+
+// Returns the direction in which Robot should try to move next.
+Direction DecideMove(Autopilot* autopilot, const Game* game) {
+  const Item* robot = &game->items[Robot];
+  if (robot->y != autopilot->y || robot->x != autopilot->x) {
+    autopilot->previous_y = autopilot->y;
+    autopilot->previous_x = autopilot->x;
+    autopilot->y = robot->y;
+    autopilot->x = robot->x;
+  }
+  return autopilot->strategy->decide(autopilot, game);
+}
+
+// Tells a bot that its game is over.
+void FinishAutopilot(Autopilot* autopilot) {
+  const RfkBot* bot = autopilot->strategy->bot;
+  if (autopilot->bot_started && bot->finish != NULL) {
+    bot->finish(autopilot->bot_state);
+  }
+  autopilot->bot_started = false;
+  FreePathFinder(&autopilot->paths);
+  free(autopilot->unreachable);
+  autopilot->unreachable = NULL;
+  autopilot->unreachable_count = 0;
+}
+
+const Game* FromRfkGame(const RfkGame* game) {
+  return &game->game;
+}
+
+static const RfkGame* ToRfkGame(const Game* game) {
+  return (const RfkGame*)game;
+}
+
+// Kitten is always item 1 inside the game, so the API swaps it with another
+// item, chosen by the seed, so that bots cannot tell which item it is.
+static size_t SwapKitten(const Game* game, size_t item_number) {
+  Random random = {.state = game->seed};
+  const size_t alias =
+      Kitten + NextRandom(&random) % (game->item_count - Kitten);
+  return item_number == Kitten  ? alias
+         : item_number == alias ? Kitten
+                                : item_number;
+}
+
+static void ApiGetSize(const RfkGame* game, int* width, int* height) {
+  *width = FromRfkGame(game)->width;
+  *height = FromRfkGame(game)->height;
+}
+
+static size_t ApiGetItemCount(const RfkGame* game) {
+  return FromRfkGame(game)->item_count;
+}
+
+static RfkItem ApiGetItem(const RfkGame* public_game, size_t item_number) {
+  const Game* game = FromRfkGame(public_game);
+  assert(item_number < game->item_count);
+  const size_t i = SwapKitten(game, item_number);
+  const Item* item = &game->items[i];
+  const bool touched = IsTouched(game, i);
+  return (RfkItem){.x = item->x,
+                   .y = item->y,
+                   .width = GetItemWidth(item),
+                   .touched = touched,
+                   .message = touched ? (int32_t)item->message : -1};
+}
+
+static size_t ApiGetItemAt(const RfkGame* public_game, int y, int x) {
+  const Game* game = FromRfkGame(public_game);
+  if (y < 0 || y >= game->height || x < 0 || x >= game->width) {
+    return RFK_NO_ITEM;
+  }
+  const uint32_t occupant = GetOccupant(game, y, x);
+  return occupant == 0 ? RFK_NO_ITEM : SwapKitten(game, occupant - 1);
+}
+
+static RfkResult ApiStep(RfkGame* public_game, RfkDirection direction,
+                         size_t* item) {
+  Game* game = &public_game->game;
+  assert(direction < RfkDirectionCount);
+  const Item* robot = &game->items[Robot];
+  size_t item_number = 0;
+  const TouchTestResult result =
+      MoveRobot(game, robot->y + Steps[direction].dy,
+                robot->x + Steps[direction].dx, &item_number, NULL);
+  switch (result) {
+    case TouchTestResultNone:
+      return RfkResultMoved;
+    case TouchTestResultRobot:
+    case TouchTestResultEdge:
+      return RfkResultBlocked;
+    case TouchTestResultKitten:
+      *item = SwapKitten(game, item_number);
+      return RfkResultKitten;
+    case TouchTestResultNonKitten:
+      *item = SwapKitten(game, item_number);
+      return RfkResultTouched;
+  }
+  return RfkResultBlocked;
+}
+
+static void ApiReset(RfkGame* game, uint64_t seed) {
+  ResetGame(&game->game, seed);
+}
+
+static RfkGame* ApiCreateGame(int width, int height,
+                              size_t non_kitten_count) {
+  RfkGame* game = malloc(sizeof(*game));
+  if (game == NULL) {
+    return NULL;
+  }
+  if (!CreateGame(&game->game, width, height, non_kitten_count)) {
+    free(game);
+    return NULL;
+  }
+  ResetGame(&game->game, 0);
+  return game;
+}
+
+static void ApiDestroyGame(RfkGame* game) {
+  DestroyGame(&game->game);
+  free(game);
+}
+
+const RfkApi Api = {
+    .version = RFK_API_VERSION,
+    .get_size = ApiGetSize,
+    .get_item_count = ApiGetItemCount,
+    .get_item = ApiGetItem,
+    .get_item_at = ApiGetItemAt,
+    .step = ApiStep,
+    .reset = ApiReset,
+    .create_game = ApiCreateGame,
+    .destroy_game = ApiDestroyGame,
+};
+
+static_assert((int)DirectionCount == (int)RfkDirectionCount &&
+                  (int)DirectionUpLeft == (int)RfkDirectionUpLeft,
+              "Direction and RfkDirection must agree");
+
+static Direction DecideBot(Autopilot* autopilot, const Game* game) {
+  const RfkBot* bot = autopilot->strategy->bot;
+  if (!autopilot->bot_started) {
+    autopilot->bot_state = bot->start(ToRfkGame(game));
+    autopilot->bot_started = true;
+  }
+  const RfkDirection d = bot->decide(autopilot->bot_state, ToRfkGame(game));
+  return d < RfkDirectionCount ? (Direction)d : DirectionUp;
+}
+
+// Loads the bot in the shared object at `path`, and returns it as a
+// Strategy.
+const Strategy* LoadBot(const char* path) {
+  static Strategy strategy;
+  void* library = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+  if (library == NULL) {
+    fprintf(stderr, "%s\n", dlerror());
+    exit(EXIT_FAILURE);
+  }
+  void* symbol = dlsym(library, RFK_BOT_ENTRY);
+  if (symbol == NULL) {
+    fprintf(stderr, "%s: no %s\n", path, RFK_BOT_ENTRY);
+    exit(EXIT_FAILURE);
+  }
+  // ISO C does not allow converting a data pointer to a function pointer,
+  // but POSIX guarantees that this works.
+  RfkGetBotFunction get_bot;
+  memcpy(&get_bot, &symbol, sizeof(get_bot));
+  const RfkBot* bot = get_bot(&Api);
+  if (bot == NULL || bot->api_version != RFK_API_VERSION) {
+    fprintf(stderr, "%s: incompatible bot API version\n", path);
+    exit(EXIT_FAILURE);
+  }
+  strategy = (Strategy){.name = bot->name, .decide = DecideBot, .bot = bot};
+  return &strategy;
+}
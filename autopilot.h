@@ -0,0 +1,95 @@
+// The autopilot, which plays Robot by itself with a choice of strategies,
+// and the in-process bot API (see robotfindskitten.h), which lets a bot
+// loaded with --bot be one of them.
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+
+#ifndef AUTOPILOT_H
+#define AUTOPILOT_H
+
+#include <stdbool.h>
+
+#include "game.h"
+#include "robotfindskitten.h"
+
+// With --autopilot, Robot plays by itself, through the same MoveRobot and
+// TouchTest as the keyboard. A Strategy decides which way to go; the
+// Autopilot keeps the state strategies share.
+typedef struct Autopilot Autopilot;
+
+typedef struct Strategy {
+  const char* name;
+  Direction (*decide)(Autopilot* autopilot, const Game* game);
+  // For a bot loaded with --bot, its description; NULL for the built-in
+  // strategies.
+  const RfkBot* bot;
+} Strategy;
+
+struct Autopilot {
+  const Strategy* strategy;
+  Random random;
+
+  // Robot's position as of the last decision, and before the last move.
+  // Strategies avoid stepping straight back, which keeps them from
+  // oscillating around obstacles.
+  int y;
+  int x;
+  int previous_y;
+  int previous_x;
+
+  // When Robot fails to get closer to its goal for too long, as when it is
+  // in a pocket of touched items, it follows a shortest path to the goal, or
+  // wanders randomly for a few moves if there is none. `path_next` is the
+  // index in paths.path of the jump point Robot is heading for. The goal is
+  // any of the cells on row goal_y from goal_min_x to goal_max_x.
+  // `stranded` says there is no path to it at all.
+  int goal_y;
+  int goal_min_x;
+  int goal_max_x;
+  int best_distance;
+  int stalled;
+  int wandering;
+  PathFinder paths;
+  size_t path_next;
+  bool stranded;
+
+  // "nearest" and "sweep": the item Robot is heading for, if any, and the
+  // items Robot found no path to, which they skip until there are no others
+  // left.
+  bool has_target;
+  size_t target;
+  bool* unreachable;
+  size_t unreachable_count;
+
+  // "sweep": the row being swept, which way, and whether Robot has touched
+  // the items toward the start of it yet.
+  int sweep_row;
+  bool sweep_right;
+  bool sweep_started;
+
+  // For a bot: its state for this game, once it has started.
+  bool bot_started;
+  void* bot_state;
+};
+
+// The bot API; see robotfindskitten.h. An RfkGame is just a Game.
+struct RfkGame {
+  Game game;
+};
+
+extern const Strategy Strategies[];
+extern const size_t StrategyCount;
+extern const RfkApi Api;
+
+const Strategy* FindStrategy(const char* name);
+void ResetAutopilot(Autopilot* autopilot, const Strategy* strategy,
+                    const Game* game);
+Direction DecideMove(Autopilot* autopilot, const Game* game);
+void FinishAutopilot(Autopilot* autopilot);
+const Game* FromRfkGame(const RfkGame* game);
+const Strategy* LoadBot(const char* path);
+
+#endif  // AUTOPILOT_H
@@ -0,0 +1,161 @@
+// An example bot for robotfindskitten. Robot heads straight for the closest
+// item it has not touched yet, turning aside when something it has already
+// touched is in the way, and never stepping straight back to where it just
+// was unless it must. It is meant to show how the API works rather than to
+// play well, and once in a while it goes around in circles forever.
+//
+// Build it with `make bots/greedy.so`, and run it with
+// `./robotfindskitten --bot bots/greedy.so`.
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "robotfindskitten.h"
+
+static const RfkApi* g_api;
+
+static const struct {
+  int dy;
+  int dx;
+} Steps[RfkDirectionCount] = {
+    {-1, 0}, {-1, 1}, {0, 1}, {1, 1}, {1, 0}, {1, -1}, {0, -1}, {-1, -1},
+};
+
+// Where Robot is, and where it was before its last move.
+typedef struct State {
+  int y;
+  int x;
+  int previous_y;
+  int previous_x;
+} State;
+
+static int Sign(int n) {
+  return (n > 0) - (n < 0);
+}
+
+static int Distance(int y0, int x0, int y1, int x1) {
+  const int dy = abs(y1 - y0);
+  const int dx = abs(x1 - x0);
+  return dy > dx ? dy : dx;
+}
+
+// Returns true if moving Robot in `direction` would not bump into the frame
+// or an item it has already touched, nor (unless `allow_backtrack`) take it
+// back to where it was.
+static bool IsUseful(const RfkGame* game, const State* state, RfkItem robot,
+                     RfkDirection direction, bool allow_backtrack) {
+  const int y = robot.y + Steps[direction].dy;
+  const int x = robot.x + Steps[direction].dx;
+  int width;
+  int height;
+  g_api->get_size(game, &width, &height);
+  if (y < 1 || y >= height - 1 || x < 1 || x + robot.width > width - 1) {
+    return false;
+  }
+  if (!allow_backtrack && y == state->previous_y && x == state->previous_x) {
+    return false;
+  }
+  for (int i = 0; i < robot.width; ++i) {
+    const size_t item = g_api->get_item_at(game, y, x + i);
+    if (item != RFK_NO_ITEM && item != RFK_ROBOT &&
+        g_api->get_item(game, item).touched) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void* Start(const RfkGame* game) {
+  State* state = malloc(sizeof(*state));
+  if (state != NULL) {
+    const RfkItem robot = g_api->get_item(game, RFK_ROBOT);
+    state->y = state->previous_y = robot.y;
+    state->x = state->previous_x = robot.x;
+  }
+  return state;
+}
+
+static void Finish(void* state) {
+  free(state);
+}
+
+static RfkDirection Decide(void* opaque_state, const RfkGame* game) {
+  State* state = opaque_state;
+  const RfkItem robot = g_api->get_item(game, RFK_ROBOT);
+  if (robot.y != state->y || robot.x != state->x) {
+    state->previous_y = state->y;
+    state->previous_x = state->x;
+    state->y = robot.y;
+    state->x = robot.x;
+  }
+  const size_t count = g_api->get_item_count(game);
+  int best_distance = -1;
+  RfkItem best = robot;
+  for (size_t i = RFK_ROBOT + 1; i < count; ++i) {
+    const RfkItem item = g_api->get_item(game, i);
+    const int distance = Distance(robot.y, robot.x, item.y, item.x);
+    if (!item.touched && (best_distance < 0 || distance < best_distance)) {
+      best_distance = distance;
+      best = item;
+    }
+  }
+
+  // Aim for the spot from which Robot's icon overlaps the item's.
+  int x = robot.x;
+  if (x < best.x - robot.width + 1) {
+    x = best.x - robot.width + 1;
+  } else if (x > best.x + best.width - 1) {
+    x = best.x + best.width - 1;
+  }
+  int width;
+  int height;
+  g_api->get_size(game, &width, &height);
+  if (x < 1) {
+    x = 1;
+  } else if (x + robot.width > width - 1) {
+    x = width - 1 - robot.width;
+  }
+  const int dy = Sign(best.y - robot.y);
+  const int dx = Sign(x - robot.x);
+  int preferred = 0;
+  for (int d = 0; d < RfkDirectionCount; ++d) {
+    if (Steps[d].dy == dy && Steps[d].dx == dx) {
+      preferred = d;
+    }
+  }
+
+  static const int Turns[] = {0, 1, -1, 2, -2, 3, -3, 4};
+  for (int pass = 0; pass < 2; ++pass) {
+    for (size_t i = 0; i < sizeof(Turns) / sizeof(Turns[0]); ++i) {
+      const RfkDirection d =
+          (RfkDirection)((preferred + Turns[i] + RfkDirectionCount) %
+                         RfkDirectionCount);
+      if (IsUseful(game, state, robot, d, pass == 1)) {
+        return d;
+      }
+    }
+  }
+  return (RfkDirection)preferred;
+}
+
+const RfkBot* RfkGetBot(const RfkApi* api);
+
+const RfkBot* RfkGetBot(const RfkApi* api) {
+  static const RfkBot bot = {
+      .api_version = RFK_API_VERSION,
+      .name = "greedy",
+      .start = Start,
+      .decide = Decide,
+      .finish = Finish,
+  };
+  if (api->version != RFK_API_VERSION) {
+    return NULL;
+  }
+  g_api = api;
+  return &bot;
+}
@@ -0,0 +1,1786 @@
+// This program is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+
+#define _DARWIN_C_SOURCE
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 700
+#define _XOPEN_SOURCE_EXTENDED
+
+#include <assert.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <wchar.h>
+
+#include "game.h"
+#include "non_kitten_items.h"
+#include "stats.h"
+
+char RobotIcon[] = "🤖";  // We are a curious robot.
+static const uint32_t RobotIconIndex = COUNT(Icons);
+
+bool StringsEqual(const char* a, const char* b) {
+  return strcmp(a, b) == 0;
+}
+
+// SplitMix64's finalizer, which scrambles the bits of `z` one-to-one.
+uint64_t MixBits(uint64_t z) {
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+  return z ^ (z >> 31);
+}
+
+uint64_t NextRandom(Random* random) {
+  return MixBits(random->state += 0x9e3779b97f4a7c15);
+}
+
+// Returns a number in [0, n).
+uint32_t RandomBelow(Random* random, uint32_t n) {
+  return (uint32_t)(NextRandom(random) % n);
+}
+
+static void Shuffle(uint32_t* array, size_t count, Random* random) {
+  for (size_t i = count - 1; i > 0; --i) {
+    const size_t j = RandomBelow(random, (uint32_t)i + 1);
+    const uint32_t temp = array[i];
+    array[i] = array[j];
+    array[j] = temp;
+  }
+}
+
+// Returns the number of screen columns `s` takes up. Most icons are emoji,
+// which take 2.
+int GetDisplayWidth(const char* s) {
+  wchar_t wide[16];
+  const size_t length = mbstowcs(wide, s, COUNT(wide));
+  if (length == (size_t)-1 || length == COUNT(wide)) {
+    return 1;
+  }
+  const int width = wcswidth(wide, length);
+  return width > 0 ? width : 1;
+}
+
+// Display widths of Icons, and of RobotIcon at the end, measured once at
+// startup.
+static int g_icon_widths[COUNT(Icons) + 1];
+
+void MeasureIcons(void) {
+  for (size_t i = 0; i < COUNT(Icons); ++i) {
+    g_icon_widths[i] = GetDisplayWidth(Icons[i]);
+  }
+  g_icon_widths[RobotIconIndex] = GetDisplayWidth(RobotIcon);
+}
+
+const char* GetIcon(const Item* item) {
+  return item->icon == RobotIconIndex ? RobotIcon : Icons[item->icon];
+}
+
+int GetItemWidth(const Item* item) {
+  return g_icon_widths[item->icon];
+}
+
+const char* GetMessage(const Item* item) {
+  return Messages[item->message];
+}
+
+// Returns true if `item`'s icon and message are ones we have, as they must
+// be before we look them up. Items read from a file or from another process
+// are checked with this.
+bool ItemIsValid(const Item* item) {
+  return item->icon <= RobotIconIndex && item->message < COUNT(Messages);
+}
+
+size_t GetCellIndex(const Game* game, int y, int x) {
+  assert(0 <= y && y < game->height && 0 <= x && x < game->width);
+  return (size_t)y * (size_t)game->width + (size_t)x;
+}
+
+uint32_t GetOccupant(const Game* game, int y, int x) {
+  return game->occupancy[GetCellIndex(game, y, x)];
+}
+
+// Returns true if no item other than `ignored` covers any of the `width` cells
+// starting at (y, x).
+static bool SpanIsFree(const Game* game, int y, int x, int width,
+                       size_t ignored) {
+  for (int i = 0; i < width; ++i) {
+    const uint32_t occupant = GetOccupant(game, y, x + i);
+    if (occupant != 0 && occupant - 1 != ignored) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void SetObstacle(Game* game, int y, int x, bool obstacle) {
+  uint64_t* row = &game->row_obstacles[(size_t)y * (size_t)game->row_words +
+                                       (size_t)(x >> 6)];
+  uint64_t* column =
+      &game->column_obstacles[(size_t)x * (size_t)game->column_words +
+                              (size_t)(y >> 6)];
+  const uint64_t row_bit = (uint64_t)1 << (x & 63);
+  const uint64_t column_bit = (uint64_t)1 << (y & 63);
+  if (obstacle) {
+    *row |= row_bit;
+    *column |= column_bit;
+  } else {
+    *row &= ~row_bit;
+    *column &= ~column_bit;
+  }
+}
+
+// Clears the obstacle bitmaps but for the frame and the bits past the ends.
+static void ResetObstacles(Game* game) {
+  memset(game->row_obstacles, 0,
+         (size_t)game->height * (size_t)game->row_words * sizeof(uint64_t));
+  memset(game->column_obstacles, 0,
+         (size_t)game->width * (size_t)game->column_words * sizeof(uint64_t));
+  // Only the last word of each row or column has bits past its end.
+  const uint64_t row_padding =
+      game->width % 64 != 0 ? ~(uint64_t)0 << (game->width % 64) : 0;
+  const uint64_t column_padding =
+      game->height % 64 != 0 ? ~(uint64_t)0 << (game->height % 64) : 0;
+  for (int y = 0; y < game->height; ++y) {
+    game->row_obstacles[(size_t)(y + 1) * (size_t)game->row_words - 1] |=
+        row_padding;
+    SetObstacle(game, y, 0, true);
+    SetObstacle(game, y, game->width - 1, true);
+  }
+  for (int x = 0; x < game->width; ++x) {
+    game->column_obstacles[(size_t)(x + 1) * (size_t)game->column_words -
+                           1] |= column_padding;
+    SetObstacle(game, 0, x, true);
+    SetObstacle(game, game->height - 1, x, true);
+  }
+}
+
+bool IsTouched(const Game* game, size_t item_number) {
+  return (game->touched[item_number / 64] >> (item_number % 64)) & 1;
+}
+
+// A game's hash is the XOR of a key for each item on the field, which
+// depends on the item, where it is, and whether Robot has touched it, so
+// that moving or touching an item updates the hash in O(1). There are too
+// many (item, cell) pairs for a table of random keys, so each key is mixed
+// from its parts instead.
+static uint64_t GetItemKey(const Game* game, size_t item_number) {
+  const Item* item = &game->items[item_number];
+  const uint64_t position =
+      (uint64_t)(uint32_t)item->y << 32 | (uint32_t)item->x;
+  const uint64_t identity =
+      (uint64_t)item_number << 1 | IsTouched(game, item_number);
+  const uint64_t key = (position ^ identity * 0x9e3779b97f4a7c15) *
+                       0xbf58476d1ce4e5b9;
+  return key ^ (key >> 31);
+}
+
+static void SetSpan(Game* game, const Item* item, uint32_t value) {
+  const size_t start = GetCellIndex(game, item->y, item->x);
+  for (int i = 0; i < GetItemWidth(item); ++i) {
+    game->occupancy[start + (size_t)i] = value;
+    if (item != &game->items[Robot]) {
+      SetObstacle(game, item->y, item->x + i, value != 0);
+    }
+  }
+}
+
+static void Occupy(Game* game, size_t item_number) {
+  SetSpan(game, &game->items[item_number], (uint32_t)item_number + 1);
+  game->hash ^= GetItemKey(game, item_number);
+}
+
+static void Vacate(Game* game, size_t item_number) {
+  SetSpan(game, &game->items[item_number], 0);
+  game->hash ^= GetItemKey(game, item_number);
+}
+
+static size_t GetBlockIndex(const Game* game, int y, int x) {
+  return (size_t)(y >> BlockShift) * (size_t)game->block_columns +
+         (size_t)(x >> BlockShift);
+}
+
+static size_t GetRegionIndex(const Game* game, int y, int x) {
+  return (size_t)(y >> (BlockShift + RegionShift)) *
+             (size_t)game->region_columns +
+         (size_t)(x >> (BlockShift + RegionShift));
+}
+
+// Returns the bit for cell (y, x) in its block's origins.
+static uint64_t GetOriginBit(int y, int x) {
+  return (uint64_t)1 << ((y & (BlockSize - 1)) * BlockSize +
+                         (x & (BlockSize - 1)));
+}
+
+static void MarkTouched(Game* game, size_t item_number) {
+  if (IsTouched(game, item_number)) {
+    return;
+  }
+  game->hash ^= GetItemKey(game, item_number);
+  game->touched[item_number / 64] |= (uint64_t)1 << (item_number % 64);
+  game->hash ^= GetItemKey(game, item_number);
+  const Item* item = &game->items[item_number];
+  ++game->block_touched[GetBlockIndex(game, item->y, item->x)];
+}
+
+// Adds the item to, or removes it from, the summaries of the block and the
+// region its origin is in.
+static void CountInBlock(Game* game, size_t item_number, bool add) {
+  const Item* item = &game->items[item_number];
+  const size_t block = GetBlockIndex(game, item->y, item->x);
+  const size_t region = GetRegionIndex(game, item->y, item->x);
+  const uint64_t origin = GetOriginBit(item->y, item->x);
+  const bool touched = IsTouched(game, item_number);
+  if (add) {
+    ++game->block_items[block];
+    game->block_touched[block] += touched;
+    game->block_origins[block] |= origin;
+    ++game->region_items[region];
+  } else {
+    --game->block_items[block];
+    game->block_touched[block] -= touched;
+    game->block_origins[block] &= ~origin;
+    --game->region_items[region];
+  }
+}
+
+static void SwapHeapEntries(CellHeap* heap, size_t a, size_t b) {
+  const uint32_t cell = heap->cells[a];
+  const uint64_t key = heap->keys[a];
+  heap->cells[a] = heap->cells[b];
+  heap->keys[a] = heap->keys[b];
+  heap->cells[b] = cell;
+  heap->keys[b] = key;
+  heap->index[heap->cells[a]] = (uint32_t)a + 1;
+  heap->index[heap->cells[b]] = (uint32_t)b + 1;
+}
+
+static void SiftHeap(CellHeap* heap, size_t i) {
+  while (i > 0 && heap->keys[(i - 1) / 2] > heap->keys[i]) {
+    SwapHeapEntries(heap, i, (i - 1) / 2);
+    i = (i - 1) / 2;
+  }
+  while (true) {
+    size_t smallest = i;
+    for (size_t child = 2 * i + 1; child <= 2 * i + 2; ++child) {
+      if (child < heap->size && heap->keys[child] < heap->keys[smallest]) {
+        smallest = child;
+      }
+    }
+    if (smallest == i) {
+      return;
+    }
+    SwapHeapEntries(heap, i, smallest);
+    i = smallest;
+  }
+}
+
+// Inserts the cell into the heap, or changes its key if it is already in.
+void QueueCell(CellHeap* heap, uint32_t cell, uint64_t key) {
+  size_t i;
+  if (heap->index[cell] == 0) {
+    i = heap->size++;
+    heap->cells[i] = cell;
+    heap->index[cell] = (uint32_t)i + 1;
+  } else {
+    i = heap->index[cell] - 1;
+  }
+  heap->keys[i] = key;
+  SiftHeap(heap, i);
+}
+
+void DequeueCell(CellHeap* heap, uint32_t cell) {
+  if (heap->index[cell] == 0) {
+    return;
+  }
+  const size_t i = heap->index[cell] - 1;
+  heap->index[cell] = 0;
+  if (i != --heap->size) {
+    heap->cells[i] = heap->cells[heap->size];
+    heap->keys[i] = heap->keys[heap->size];
+    heap->index[heap->cells[i]] = (uint32_t)i + 1;
+    SiftHeap(heap, i);
+  }
+}
+
+// Empties the heap, in time proportional to what is in it.
+void ClearCellHeap(CellHeap* heap) {
+  for (size_t i = 0; i < heap->size; ++i) {
+    heap->index[heap->cells[i]] = 0;
+  }
+  heap->size = 0;
+}
+
+void FreeCellHeap(CellHeap* heap) {
+  free(heap->cells);
+  free(heap->keys);
+  free(heap->index);
+  memset(heap, 0, sizeof(*heap));
+}
+
+// (Re)allocates the heap with room for every cell of a field, and empties it.
+bool AllocateCellHeap(CellHeap* heap, size_t cells) {
+  FreeCellHeap(heap);
+  heap->cells = malloc(cells * sizeof(uint32_t));
+  heap->keys = malloc(cells * sizeof(uint64_t));
+  heap->index = calloc(cells, sizeof(uint32_t));
+  return heap->cells != NULL && heap->keys != NULL && heap->index != NULL;
+}
+
+// Returns how many items a field of the given size can hold. Half of it is
+// left empty, so that placing items at random spots finds one quickly.
+size_t GetFieldCapacity(int width, int height) {
+  if (width < 2 + 2 * FrameThickness || height < 1 + 2 * FrameThickness) {
+    return 0;
+  }
+  const size_t interior = (size_t)(width - 2 * FrameThickness) *
+                          (size_t)(height - 2 * FrameThickness);
+  return interior / 2;
+}
+
+// Returns true if a field of this size has room for this many items.
+bool FieldCanHold(int width, int height, size_t item_count) {
+  return item_count <= GetFieldCapacity(width, height);
+}
+
+static size_t GetTouchedWords(size_t item_count) {
+  return (item_count + 63) / 64;
+}
+
+// (Re)allocates the per-cell and per-block arrays for a field of the given
+// size. The caller must fill them in.
+static bool AllocateField(Game* game, int width, int height) {
+  free(game->occupancy);
+  free(game->block_items);
+  free(game->block_touched);
+  free(game->block_visits);
+  free(game->block_origins);
+  free(game->region_items);
+  free(game->row_obstacles);
+  free(game->column_obstacles);
+  game->width = width;
+  game->height = height;
+  game->block_columns = (width + BlockSize - 1) >> BlockShift;
+  game->block_rows = (height + BlockSize - 1) >> BlockShift;
+  const size_t blocks =
+      (size_t)game->block_columns * (size_t)game->block_rows;
+  game->occupancy = calloc((size_t)width * (size_t)height, sizeof(uint32_t));
+  // No item is on the field yet.
+  game->hash = 0;
+  game->block_items = calloc(blocks, sizeof(uint32_t));
+  game->block_touched = calloc(blocks, sizeof(uint32_t));
+  game->block_visits = calloc(blocks, sizeof(uint32_t));
+  game->block_origins = calloc(blocks, sizeof(uint64_t));
+  game->region_columns =
+      (game->block_columns + RegionSize - 1) >> RegionShift;
+  game->region_rows = (game->block_rows + RegionSize - 1) >> RegionShift;
+  game->region_items =
+      calloc((size_t)game->region_columns * (size_t)game->region_rows,
+             sizeof(uint32_t));
+  game->row_words = (width + 63) / 64;
+  game->column_words = (height + 63) / 64;
+  game->row_obstacles =
+      malloc((size_t)height * (size_t)game->row_words * sizeof(uint64_t));
+  game->column_obstacles =
+      malloc((size_t)width * (size_t)game->column_words * sizeof(uint64_t));
+  if (game->occupancy == NULL || game->block_items == NULL ||
+      game->block_touched == NULL || game->block_visits == NULL ||
+      game->block_origins == NULL || game->region_items == NULL ||
+      game->row_obstacles == NULL || game->column_obstacles == NULL) {
+    return false;
+  }
+  ResetObstacles(game);
+  return true;
+}
+
+void FreePathFinder(PathFinder* finder) {
+  free(finder->cost);
+  free(finder->parent);
+  free(finder->generations);
+  free(finder->path);
+  FreeCellHeap(&finder->open);
+  memset(finder, 0, sizeof(*finder));
+}
+
+void DestroyGame(Game* game) {
+  if (game->snapshot != NULL) {
+    munmap(game->snapshot, game->snapshot_size);
+  } else {
+    free(game->items);
+    free(game->touched);
+  }
+  free(game->order);
+  free(game->moves);
+  free(game->occupancy);
+  free(game->block_items);
+  free(game->block_touched);
+  free(game->block_visits);
+  free(game->block_origins);
+  free(game->region_items);
+  free(game->row_obstacles);
+  free(game->column_obstacles);
+  free(game->distance.g);
+  free(game->distance.rhs);
+  FreeCellHeap(&game->distance.queue);
+  free(game->kitten_distances.distances);
+  free(game->kitten_distances.queue);
+  FreePathFinder(&game->paths);
+  free(game->sight.flags);
+  free(game->sight.changes);
+  free(game->sampler.grid);
+  free(game->sampler.points);
+  free(game->sampler.active);
+  memset(game, 0, sizeof(*game));
+}
+
+// Allocates the scratch space for shuffling and for recording moves.
+static bool AllocateScratch(Game* game) {
+  game->order = calloc(COUNT(Messages) > COUNT(Icons) ? COUNT(Messages)
+                                                      : COUNT(Icons),
+                       sizeof(uint32_t));
+  game->moves = calloc(game->item_capacity, sizeof(ItemMove));
+  return game->order != NULL && game->moves != NULL;
+}
+
+// Allocates a game with room for Robot, Kitten, and `non_kitten_count` other
+// items on a field of the given size. Returns false if they do not fit, or
+// if memory runs out.
+bool CreateGame(Game* game, int width, int height, size_t non_kitten_count) {
+  memset(game, 0, sizeof(*game));
+  game->item_count = game->item_capacity = Bogus + non_kitten_count;
+  if (!FieldCanHold(width, height, game->item_count)) {
+    return false;
+  }
+  game->items = calloc(game->item_count, sizeof(Item));
+  game->touched = calloc(GetTouchedWords(game->item_count), sizeof(uint64_t));
+  if (game->items == NULL || game->touched == NULL ||
+      !AllocateScratch(game) || !AllocateField(game, width, height)) {
+    DestroyGame(game);
+    return false;
+  }
+  return true;
+}
+
+// Makes room for up to `capacity` items, so that later rounds can have more
+// items than this one without allocating. Returns false, leaving the game
+// unchanged, if memory runs out.
+bool ReserveItems(Game* game, size_t capacity) {
+  if (capacity <= game->item_capacity) {
+    return true;
+  }
+  Item* items = calloc(capacity, sizeof(Item));
+  uint64_t* touched = calloc(GetTouchedWords(capacity), sizeof(uint64_t));
+  ItemMove* moves = calloc(capacity, sizeof(ItemMove));
+  if (items == NULL || touched == NULL || moves == NULL) {
+    free(items);
+    free(touched);
+    free(moves);
+    return false;
+  }
+  memcpy(items, game->items, game->item_count * sizeof(Item));
+  memcpy(touched, game->touched,
+         GetTouchedWords(game->item_count) * sizeof(uint64_t));
+  if (game->snapshot != NULL) {
+    munmap(game->snapshot, game->snapshot_size);
+    game->snapshot = NULL;
+  } else {
+    free(game->items);
+    free(game->touched);
+  }
+  free(game->moves);
+  game->items = items;
+  game->touched = touched;
+  game->moves = moves;
+  game->item_capacity = capacity;
+  return true;
+}
+
+// Records the item in the occupancy grid and its block's count.
+static void AddItem(Game* game, size_t item_number) {
+  Occupy(game, item_number);
+  if (item_number != Robot) {
+    CountInBlock(game, item_number, true);
+  }
+}
+
+// Puts the item at a random free spot.
+static void PlaceItem(Game* game, size_t item_number) {
+  Item* item = &game->items[item_number];
+  const int width = GetItemWidth(item);
+  do {
+    item->y = FrameThickness +
+              (int)RandomBelow(&game->random,
+                               (uint32_t)(game->height - FrameThickness * 2));
+    item->x = FrameThickness +
+              (int)RandomBelow(&game->random, (uint32_t)(game->width -
+                                                         FrameThickness * 2 -
+                                                         width + 1));
+  } while (!SpanIsFree(game, item->y, item->x, width, SIZE_MAX));
+  AddItem(game, item_number);
+}
+
+// Returns true if an icon `width` cells wide at (y, x) is inside the frame.
+bool IsInside(const Game* game, int y, int x, int width) {
+  return y >= FrameThickness && y < game->height - FrameThickness &&
+         x >= FrameThickness && x + width <= game->width - FrameThickness;
+}
+
+// With --hard, Kitten runs from Robot: each tick, it moves to whichever
+// neighboring spot is farthest from Robot by path, going around the other
+// items. The path distances from Robot form a distance field, which we keep
+// up to date incrementally, D* Lite style, rather than recomputing it every
+// tick. The search is rooted at Robot's cell and focused on Kitten's, so it
+// only settles the cells that can matter to Kitten. When an item moves, only
+// the cells whose distances change are searched again; when Kitten moves, km
+// shifts the priorities instead of rebuilding the queue. Kitten only hears
+// Robot coming from EarshotRange steps away, and the search goes no farther,
+// so its cost does not grow with the size of the field.
+//
+// The field is a graph of cells, each joined to its 8 neighbors by edges of
+// length 1, except that the edges into a blocked cell (the frame, or an item
+// other than Robot and Kitten) are infinitely long. g is a cell's distance as
+// of the last time the search settled it, and rhs its distance as computed
+// from its neighbors' g; the queue holds the cells where the two disagree.
+
+static uint32_t AddDistance(uint32_t a, uint32_t b) {
+  return a >= Infinity - b ? Infinity : a + b;
+}
+
+static bool IsBlocked(const Game* game, uint32_t cell) {
+  const uint32_t width = (uint32_t)game->width;
+  const uint32_t x = cell % width;
+  if (cell < width || cell >= (uint32_t)(game->height - 1) * width ||
+      x == 0 || x == width - 1) {
+    return true;
+  }
+  const uint32_t occupant = game->occupancy[cell];
+  return occupant != 0 && occupant - 1 != Robot && occupant - 1 != Kitten;
+}
+
+// The Chebyshev distance from Kitten's cell, which is never more than the
+// path distance, since a step can be diagonal.
+static uint32_t GetHeuristic(const Game* game, uint32_t cell) {
+  const uint32_t width = (uint32_t)game->width;
+  const int dy = abs((int)(cell / width) - game->distance.start_y);
+  const int dx = abs((int)(cell % width) - game->distance.start_x);
+  return (uint32_t)(dy > dx ? dy : dx);
+}
+
+// Cells come off the queue in order of their estimated distance through them
+// to Kitten, and then of their distance from Robot.
+static uint64_t CalculateKey(const Game* game, uint32_t cell) {
+  const DistanceField* field = &game->distance;
+  const uint32_t g = field->g[cell] < field->rhs[cell] ? field->g[cell]
+                                                       : field->rhs[cell];
+  if (g == Infinity) {
+    return UINT64_MAX;
+  }
+  return (uint64_t)AddDistance(g, GetHeuristic(game, cell) + field->km)
+             << 32 |
+         g;
+}
+
+// The offsets of a cell's 8 neighbors in the cell arrays. Only cells inside
+// the frame are ever expanded, so their neighbors are all on the field.
+static void GetNeighborOffsets(const Game* game,
+                               ptrdiff_t offsets[DirectionCount]) {
+  for (int d = 0; d < DirectionCount; ++d) {
+    offsets[d] = (ptrdiff_t)Steps[d].dy * game->width + Steps[d].dx;
+  }
+}
+
+// Recomputes the cell's rhs, and queues it if that makes it inconsistent.
+static void UpdateCell(Game* game, uint32_t cell) {
+  DistanceField* field = &game->distance;
+  if (cell != field->source) {
+    uint32_t rhs = Infinity;
+    if (!IsBlocked(game, cell)) {
+      ptrdiff_t offsets[DirectionCount];
+      GetNeighborOffsets(game, offsets);
+      for (int d = 0; d < DirectionCount; ++d) {
+        const uint32_t g = field->g[(ptrdiff_t)cell + offsets[d]];
+        if (g < rhs) {
+          rhs = g;
+        }
+      }
+      rhs = AddDistance(rhs, 1);
+    }
+    field->rhs[cell] = rhs;
+  }
+  if (field->g[cell] != field->rhs[cell]) {
+    QueueCell(&field->queue, cell, CalculateKey(game, cell));
+  } else {
+    DequeueCell(&field->queue, cell);
+  }
+}
+
+// Searches until the distance of `target` from Robot is known, or known to
+// be more than EarshotRange.
+static void ComputeShortestPath(Game* game, uint32_t target) {
+  DistanceField* field = &game->distance;
+  ptrdiff_t offsets[DirectionCount];
+  GetNeighborOffsets(game, offsets);
+  // Keys include the heuristic, so the horizon must include the target's,
+  // or a neighbor of Kitten's cell EarshotRange away would never settle.
+  const uint64_t horizon =
+      (uint64_t)(EarshotRange + GetHeuristic(game, target) + field->km + 1)
+      << 32;
+  const CellHeap* queue = &field->queue;
+  while (queue->size > 0 && queue->keys[0] < horizon &&
+         (queue->keys[0] < CalculateKey(game, target) ||
+          field->rhs[target] != field->g[target])) {
+    const uint32_t cell = queue->cells[0];
+    const uint64_t new_key = CalculateKey(game, cell);
+    if (queue->keys[0] < new_key) {
+      // Kitten has moved since the cell was queued.
+      QueueCell(&field->queue, cell, new_key);
+      continue;
+    }
+    if (field->g[cell] > field->rhs[cell]) {
+      // The cell has come closer to Robot.
+      field->g[cell] = field->rhs[cell];
+      DequeueCell(&field->queue, cell);
+    } else {
+      // The cell has gone farther from Robot, or been cut off.
+      field->g[cell] = Infinity;
+      UpdateCell(game, cell);
+    }
+    for (int d = 0; d < DirectionCount; ++d) {
+      UpdateCell(game, (uint32_t)((ptrdiff_t)cell + offsets[d]));
+    }
+  }
+}
+
+// Returns the length of the shortest path from Robot to (y, x), or Infinity
+// if it is longer than EarshotRange, or there is none.
+static uint32_t GetPathDistance(Game* game, int y, int x) {
+  const DistanceField* field = &game->distance;
+  const uint32_t cell = (uint32_t)GetCellIndex(game, y, x);
+  ComputeShortestPath(game, cell);
+  return field->g[cell] == field->rhs[cell] && field->g[cell] <= EarshotRange
+             ? field->g[cell]
+             : Infinity;
+}
+
+static void SetDistanceStart(Game* game, int y, int x) {
+  DistanceField* field = &game->distance;
+  field->start = (uint32_t)GetCellIndex(game, y, x);
+  field->start_y = y;
+  field->start_x = x;
+}
+
+// Starts the search over, for a new game or a new field size. If memory runs
+// out, Kitten stops evading.
+static void ResetDistanceField(Game* game) {
+  DistanceField* field = &game->distance;
+  const size_t cells = (size_t)game->width * (size_t)game->height;
+  if (cells != field->cells) {
+    free(field->g);
+    free(field->rhs);
+    field->cells = cells;
+    field->g = malloc(cells * sizeof(uint32_t));
+    field->rhs = malloc(cells * sizeof(uint32_t));
+    if (field->g == NULL || field->rhs == NULL ||
+        !AllocateCellHeap(&field->queue, cells)) {
+      field->cells = 0;
+      game->kitten_evades = false;
+      return;
+    }
+  }
+  memset(field->g, 0xff, cells * sizeof(uint32_t));
+  memset(field->rhs, 0xff, cells * sizeof(uint32_t));
+  ClearCellHeap(&field->queue);
+  field->km = 0;
+  const Item* robot = &game->items[Robot];
+  const Item* kitten = &game->items[Kitten];
+  field->source = (uint32_t)GetCellIndex(game, robot->y, robot->x);
+  SetDistanceStart(game, kitten->y, kitten->x);
+  field->rhs[field->source] = 0;
+  QueueCell(&field->queue, field->source, CalculateKey(game, field->source));
+}
+
+// Tells the search that the `width` cells from (y, x) have been blocked or
+// unblocked.
+static void UpdateDistanceField(Game* game, int y, int x, int width) {
+  for (int i = 0; i < width; ++i) {
+    UpdateCell(game, (uint32_t)GetCellIndex(game, y, x + i));
+  }
+}
+
+// Moves the root of the search to Robot's cell. Every distance may change, so
+// this is the expensive update; doing it once per tick, rather than on every
+// move, means Robot can move many times for the price of one.
+static void UpdateDistanceSource(Game* game) {
+  DistanceField* field = &game->distance;
+  const Item* robot = &game->items[Robot];
+  const uint32_t old_source = field->source;
+  field->source = (uint32_t)GetCellIndex(game, robot->y, robot->x);
+  if (field->source != old_source) {
+    field->rhs[field->source] = 0;
+    UpdateCell(game, field->source);
+    UpdateCell(game, old_source);
+  }
+}
+
+// If Kitten can hear Robot, moves it to whichever neighboring spot (or its
+// own) is farthest from Robot by path.
+static void MoveKitten(Game* game) {
+  DistanceField* field = &game->distance;
+  Item* kitten = &game->items[Kitten];
+  const int width = GetItemWidth(kitten);
+  UpdateDistanceSource(game);
+  uint32_t best_distance = GetPathDistance(game, kitten->y, kitten->x);
+  if (best_distance == Infinity) {
+    return;
+  }
+  int best_y = kitten->y;
+  int best_x = kitten->x;
+  for (int d = 0; d < DirectionCount; ++d) {
+    const int y = kitten->y + Steps[d].dy;
+    const int x = kitten->x + Steps[d].dx;
+    if (!IsInside(game, y, x, width) ||
+        !SpanIsFree(game, y, x, width, Kitten)) {
+      continue;
+    }
+    // Out of earshot, or cut off from Robot, is best of all.
+    const uint32_t distance = GetPathDistance(game, y, x);
+    if (distance > best_distance) {
+      best_distance = distance;
+      best_y = y;
+      best_x = x;
+    }
+  }
+  if (best_y == kitten->y && best_x == kitten->x) {
+    return;
+  }
+  game->moves[game->move_count++] =
+      (ItemMove){.item = (uint32_t)Kitten, .x = kitten->x, .y = kitten->y};
+  Vacate(game, Kitten);
+  CountInBlock(game, Kitten, false);
+  kitten->y = best_y;
+  kitten->x = best_x;
+  CountInBlock(game, Kitten, true);
+  Occupy(game, Kitten);
+
+  const uint32_t old_start = field->start;
+  SetDistanceStart(game, best_y, best_x);
+  field->km += GetHeuristic(game, old_start);
+}
+
+// For the hint key, the path distance from every cell to Kitten, with the
+// same obstacles as --hard. It is a breadth-first search from Kitten over the
+// whole field, which is too slow to run on every keypress on a big field,
+// so it is computed when first needed and kept until something other than
+// Robot moves; after that, each hint is a lookup.
+static void ComputeKittenDistances(Game* game) {
+  DistanceTransform* transform = &game->kitten_distances;
+  const size_t cells = (size_t)game->width * (size_t)game->height;
+  if (cells != transform->cells) {
+    free(transform->distances);
+    free(transform->queue);
+    transform->cells = cells;
+    transform->distances = malloc(cells * sizeof(uint32_t));
+    transform->queue = malloc(cells * sizeof(uint32_t));
+    if (transform->distances == NULL || transform->queue == NULL) {
+      free(transform->distances);
+      free(transform->queue);
+      memset(transform, 0, sizeof(*transform));
+      return;
+    }
+  }
+  memset(transform->distances, 0xff, cells * sizeof(uint32_t));
+  size_t head = 0;
+  size_t tail = 0;
+  const Item* kitten = &game->items[Kitten];
+  for (int i = 0; i < GetItemWidth(kitten); ++i) {
+    const uint32_t cell =
+        (uint32_t)GetCellIndex(game, kitten->y, kitten->x + i);
+    transform->distances[cell] = 0;
+    transform->queue[tail++] = cell;
+  }
+  ptrdiff_t offsets[DirectionCount];
+  GetNeighborOffsets(game, offsets);
+  while (head < tail) {
+    const uint32_t cell = transform->queue[head++];
+    for (int d = 0; d < DirectionCount; ++d) {
+      const uint32_t neighbor = (uint32_t)((ptrdiff_t)cell + offsets[d]);
+      if (transform->distances[neighbor] == Infinity &&
+          !IsBlocked(game, neighbor)) {
+        transform->distances[neighbor] = transform->distances[cell] + 1;
+        transform->queue[tail++] = neighbor;
+      }
+    }
+  }
+  transform->stale = false;
+}
+
+// Returns the number of steps Robot is from Kitten, going around the other
+// items, or Infinity if there is no way through.
+uint32_t GetKittenDistance(Game* game) {
+  DistanceTransform* transform = &game->kitten_distances;
+  if (transform->stale || transform->cells == 0) {
+    ComputeKittenDistances(game);
+    if (transform->cells == 0) {
+      return Infinity;
+    }
+  }
+  const Item* robot = &game->items[Robot];
+  uint32_t distance = Infinity;
+  for (int i = 0; i < GetItemWidth(robot); ++i) {
+    const uint32_t d =
+        transform->distances[GetCellIndex(game, robot->y, robot->x + i)];
+    if (d < distance) {
+      distance = d;
+    }
+  }
+  return distance;
+}
+
+// With --fog, Robot sees only the cells within sight.radius of it that no
+// other item hides, and only the items on those cells are drawn. Sight is
+// cast by recursive shadowcasting, after Björn Bergström: each of the 8
+// octants around Robot is scanned row by row outwards, and each run of
+// obstacles narrows the range of slopes the rows beyond it can be seen
+// through. An octant's cells depend only on the obstacles in that octant,
+// so when an item moves, only the octants it left or entered are cast
+// again. The update lists the cells whose visibility changed, so the caller
+// repaints only those, and it never looks beyond the radius, so its cost
+// does not grow with the size of the field or the number of items.
+enum { AllOctants = 0xff, SeenFlag = 1 << 8, ListedFlag = 1 << 9 };
+
+// Maps an octant's (column, row) to an offset from Robot: x is column * xx +
+// row * xy, and y is column * yx + row * yy. Rows run from 0 down to
+// -radius, and each row's columns from the row number up to 0.
+static const struct {
+  int xx;
+  int xy;
+  int yx;
+  int yy;
+} Octants[8] = {
+    {1, 0, 0, 1},  {0, 1, 1, 0},   {0, -1, 1, 0}, {-1, 0, 0, 1},
+    {-1, 0, 0, -1}, {0, -1, -1, 0}, {0, 1, -1, 0}, {1, 0, 0, -1},
+};
+
+// Returns the octants around the sight origin that (y, x) is in. A cell on
+// the boundary between two is in both.
+static unsigned int GetOctants(const FieldOfView* sight, int y, int x) {
+  const int dy = y - sight->origin_y;
+  const int dx = x - sight->origin_x;
+  if (abs(dy) > sight->radius || abs(dx) > sight->radius) {
+    return 0;
+  }
+  unsigned int octants = 0;
+  for (unsigned int o = 0; o < COUNT(Octants); ++o) {
+    const int column = dx * Octants[o].xx + dy * Octants[o].yx;
+    const int row = dx * Octants[o].xy + dy * Octants[o].yy;
+    if (row <= column && column <= 0) {
+      octants |= 1u << o;
+    }
+  }
+  return octants;
+}
+
+static bool BlocksSight(const Game* game, int y, int x) {
+  if (y < 0 || y >= game->height || x < 0 || x >= game->width) {
+    return true;
+  }
+  return (game->row_obstacles[(size_t)y * (size_t)game->row_words +
+                              (size_t)(x >> 6)] >>
+          (x & 63)) &
+         1;
+}
+
+// Adds the cell to sight->changes, unless it is already there.
+static void ListCell(FieldOfView* sight, size_t cell) {
+  if ((sight->flags[cell] & ListedFlag) == 0) {
+    sight->flags[cell] |= ListedFlag;
+    sight->changes[sight->change_count++] = (uint32_t)cell;
+  }
+}
+
+// Marks the cells of `octant` that are visible from `row` outwards through
+// the slopes from `start` down to `end`. Each run of obstacles splits the
+// slopes: the ones past the run's near side are scanned by a recursive call,
+// and this call carries on past its far side.
+static void CastLight(Game* game, unsigned int octant, int row, double start,
+                      double end) {
+  FieldOfView* sight = &game->sight;
+  const int radius = sight->radius;
+  if (start < end) {
+    return;
+  }
+  double next_start = start;
+  for (int j = row; j <= radius; ++j) {
+    const int dy = -j;
+    bool blocked = false;
+    for (int dx = -j; dx <= 0; ++dx) {
+      const double left = ((double)dx - 0.5) / ((double)dy + 0.5);
+      const double right = ((double)dx + 0.5) / ((double)dy - 0.5);
+      if (start < right) {
+        continue;
+      }
+      if (end > left) {
+        break;
+      }
+      const int x = sight->origin_x + dx * Octants[octant].xx +
+                    dy * Octants[octant].xy;
+      const int y = sight->origin_y + dx * Octants[octant].yx +
+                    dy * Octants[octant].yy;
+      const bool obstacle = BlocksSight(game, y, x);
+      if (dx * dx + dy * dy <= (int64_t)radius * radius && y >= 0 &&
+          y < game->height && x >= 0 && x < game->width) {
+        const size_t cell = GetCellIndex(game, y, x);
+        sight->flags[cell] |= (uint16_t)(1u << octant);
+        ListCell(sight, cell);
+      }
+      if (blocked) {
+        if (obstacle) {
+          next_start = right;
+        } else {
+          blocked = false;
+          start = next_start;
+        }
+      } else if (obstacle && j < radius) {
+        blocked = true;
+        CastLight(game, octant, j + 1, start, left);
+        next_start = right;
+      }
+    }
+    if (blocked) {
+      break;
+    }
+  }
+}
+
+// Casts `octants` again from Robot's cell, and leaves in sight->changes the
+// cells that came into or went out of sight.
+static void UpdateFieldOfView(Game* game, unsigned int octants) {
+  FieldOfView* sight = &game->sight;
+  const int radius = sight->radius;
+  const uint16_t bits = (uint16_t)octants;
+  sight->change_count = 0;
+
+  // Forget what the octants saw from where they were last cast...
+  const int top = sight->origin_y - radius < 0 ? 0 : sight->origin_y - radius;
+  const int left = sight->origin_x - radius < 0 ? 0 : sight->origin_x - radius;
+  for (int y = top; y <= sight->origin_y + radius && y < game->height; ++y) {
+    for (int x = left; x <= sight->origin_x + radius && x < game->width;
+         ++x) {
+      const size_t cell = GetCellIndex(game, y, x);
+      if (sight->flags[cell] & bits) {
+        sight->flags[cell] &= (uint16_t)~bits;
+        ListCell(sight, cell);
+      }
+    }
+  }
+
+  // ...and see afresh from where Robot is now.
+  const Item* robot = &game->items[Robot];
+  sight->origin_y = robot->y;
+  sight->origin_x = robot->x;
+  const size_t origin = GetCellIndex(game, robot->y, robot->x);
+  sight->flags[origin] |= bits;
+  ListCell(sight, origin);
+  for (unsigned int o = 0; o < COUNT(Octants); ++o) {
+    if (octants & (1u << o)) {
+      CastLight(game, o, 1, 1.0, 0.0);
+    }
+  }
+
+  // Keep just the cells whose visibility changed.
+  size_t count = 0;
+  for (size_t i = 0; i < sight->change_count; ++i) {
+    const uint32_t cell = sight->changes[i];
+    uint16_t* flags = &sight->flags[cell];
+    *flags &= (uint16_t)~ListedFlag;
+    const bool seen = (*flags & AllOctants) != 0;
+    if (seen != ((*flags & SeenFlag) != 0)) {
+      *flags ^= SeenFlag;
+      sight->changes[count++] = cell;
+    }
+  }
+  sight->change_count = count;
+}
+
+// Updates sight for the items that moved in the last tick.
+static void UpdateSightForMoves(Game* game) {
+  FieldOfView* sight = &game->sight;
+  sight->change_count = 0;
+  unsigned int octants = 0;
+  for (size_t i = 0; i < game->move_count; ++i) {
+    const ItemMove* move = &game->moves[i];
+    const Item* item = &game->items[move->item];
+    for (int j = 0; j < GetItemWidth(item); ++j) {
+      octants |= GetOctants(sight, move->y, move->x + j) |
+                 GetOctants(sight, item->y, item->x + j);
+    }
+  }
+  if (octants != 0) {
+    UpdateFieldOfView(game, octants);
+  }
+}
+
+// Sees the whole field afresh, as at the start of a game. If memory runs
+// out, the fog lifts.
+static void ResetFieldOfView(Game* game) {
+  FieldOfView* sight = &game->sight;
+  const size_t cells = (size_t)game->width * (size_t)game->height;
+  if (cells != sight->cells) {
+    free(sight->flags);
+    free(sight->changes);
+    sight->cells = cells;
+    sight->flags = malloc(cells * sizeof(uint16_t));
+    // Each cell is listed at most once per update.
+    sight->changes = malloc(cells * sizeof(uint32_t));
+    if (sight->flags == NULL || sight->changes == NULL) {
+      free(sight->flags);
+      free(sight->changes);
+      memset(sight, 0, sizeof(*sight));
+      return;
+    }
+  }
+  memset(sight->flags, 0, cells * sizeof(uint16_t));
+  sight->origin_y = game->items[Robot].y;
+  sight->origin_x = game->items[Robot].x;
+  UpdateFieldOfView(game, AllOctants);
+}
+
+// Returns true if Robot can see any cell of the item.
+bool ItemIsSeen(const Game* game, const Item* item) {
+  if (game->sight.radius == 0) {
+    return true;
+  }
+  const size_t start = GetCellIndex(game, item->y, item->x);
+  for (int i = 0; i < GetItemWidth(item); ++i) {
+    if (game->sight.flags[start + (size_t)i] & SeenFlag) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Recomputes what follows from where the items are: Kitten's distances, the
+// distance field Kitten runs by, and what Robot can see.
+void ResetDerivedState(Game* game) {
+  game->kitten_distances.stale = true;
+  if (game->kitten_evades) {
+    ResetDistanceField(game);
+  }
+  if (game->sight.radius > 0) {
+    ResetFieldOfView(game);
+  }
+}
+
+// Returns the largest r with r * r <= n.
+static uint64_t IntegerSquareRoot(uint64_t n) {
+  uint64_t root = 0;
+  for (int shift = 31; shift >= 0; --shift) {
+    const uint64_t candidate = root | (uint64_t)1 << shift;
+    if (candidate * candidate <= n) {
+      root = candidate;
+    }
+  }
+  return root;
+}
+
+// With --spacing, the items are spread out by Poisson-disk sampling, after
+// Robert Bridson: starting from a point at random, each new point is tried
+// at random between one and two spacings from a point already placed, and
+// kept if no other point is closer than the spacing. A point around which
+// SamplingAttempts tries in a row fail is never tried from again. The
+// background grid's cells are too small to hold two points, so finding the
+// points near a candidate takes constant time. Distances count a row as two
+// columns, since a terminal cell is about twice as tall as it is wide.
+//
+// The whole field is filled with points, and the items take a random subset
+// of them; filling only as many points as there are items would leave them
+// in a clump around the first. So that filling the field costs time in
+// proportion to the number of items, not the size of the field, the spacing
+// is raised, if need be, until the field holds about twice as many points as
+// items. If a fill leaves fewer points than items, the spacing is lowered
+// towards the one asked for, and if even that leaves too few, the items are
+// placed uniformly, as they are without --spacing. (Placing just the extra
+// items uniformly could wedge: the points can leave no gap wide enough for
+// a wide icon.)
+enum { SamplingAttempts = 30 };
+
+static uint32_t* GetSampleCell(PoissonSampler* sampler, SamplePoint point) {
+  const int y = (point.y - FrameThickness) / sampler->cell_rows;
+  const int x = (point.x - FrameThickness) / sampler->cell_columns;
+  return &sampler->grid[y * sampler->grid_columns + x];
+}
+
+// Returns true if no point is closer to `point` than the spacing.
+static bool HasRoomFor(const PoissonSampler* sampler, SamplePoint point) {
+  const int grid_y = (point.y - FrameThickness) / sampler->cell_rows;
+  const int grid_x = (point.x - FrameThickness) / sampler->cell_columns;
+  const int top = grid_y > sampler->reach_y ? grid_y - sampler->reach_y : 0;
+  const int left = grid_x > sampler->reach_x ? grid_x - sampler->reach_x : 0;
+  const int bottom = grid_y + sampler->reach_y < sampler->grid_rows
+                         ? grid_y + sampler->reach_y
+                         : sampler->grid_rows - 1;
+  const int right = grid_x + sampler->reach_x < sampler->grid_columns
+                        ? grid_x + sampler->reach_x
+                        : sampler->grid_columns - 1;
+  for (int y = top; y <= bottom; ++y) {
+    for (int x = left; x <= right; ++x) {
+      const uint32_t other = sampler->grid[y * sampler->grid_columns + x];
+      if (other == 0) {
+        continue;
+      }
+      const int64_t dy = sampler->points[other - 1].y - point.y;
+      const int64_t dx = sampler->points[other - 1].x - point.x;
+      if ((uint64_t)(dx * dx + 4 * dy * dy) < sampler->spacing_squared) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// The last column is left out, so that a wide icon fits on any point.
+static int GetSampleColumns(const Game* game) {
+  return game->width - 2 * FrameThickness - 1;
+}
+
+// Tries SamplingAttempts points around `from`, and returns true, with the
+// point in `point`, if one has room.
+static bool FindSample(Game* game, SamplePoint from, SamplePoint* point) {
+  const PoissonSampler* sampler = &game->sampler;
+  const int64_t spacing = (int64_t)sampler->distance;
+  for (int attempt = 0; attempt < SamplingAttempts; ++attempt) {
+    // Pick an offset in the ring between one and two spacings out. Each try
+    // takes both coordinates from one random number, scaled by multiplying
+    // rather than by RandomBelow's division, which would be most of the
+    // cost of sampling.
+    int64_t dy;
+    int64_t dx;
+    uint64_t distance_squared;
+    do {
+      const uint64_t bits = NextRandom(&game->random);
+      dy = (int64_t)((bits >> 32) * (uint64_t)(2 * spacing + 1) >> 32) -
+           spacing;
+      dx = (int64_t)((bits & UINT32_MAX) * (uint64_t)(4 * spacing + 1) >> 32) -
+           2 * spacing;
+      distance_squared = (uint64_t)(dx * dx + 4 * dy * dy);
+    } while (distance_squared < sampler->spacing_squared ||
+             distance_squared > 4 * sampler->spacing_squared);
+    point->y = from.y + (int)dy;
+    point->x = from.x + (int)dx;
+    if (point->y >= FrameThickness &&
+        point->y < game->height - FrameThickness &&
+        point->x >= FrameThickness &&
+        point->x < FrameThickness + GetSampleColumns(game) &&
+        *GetSampleCell(&game->sampler, *point) == 0 &&
+        HasRoomFor(sampler, *point)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Fills the field with points `spacing` apart, and returns how many there
+// are. Returns 0 if memory runs out.
+static size_t FillWithSamples(Game* game, uint64_t spacing) {
+  PoissonSampler* sampler = &game->sampler;
+  const int rows = game->height - 2 * FrameThickness;
+  const int columns = GetSampleColumns(game);
+  sampler->distance = spacing;
+  sampler->spacing_squared = spacing * spacing;
+  // No two points in a grid cell are a spacing apart.
+  const uint64_t cell_rows = IntegerSquareRoot(sampler->spacing_squared / 8);
+  sampler->cell_rows = cell_rows > 0 ? (int)cell_rows : 1;
+  sampler->cell_columns =
+      (int)IntegerSquareRoot(sampler->spacing_squared / 2);
+  sampler->grid_rows = (rows + sampler->cell_rows - 1) / sampler->cell_rows;
+  sampler->grid_columns =
+      (columns + sampler->cell_columns - 1) / sampler->cell_columns;
+  sampler->reach_y = (int)(spacing / 2) / sampler->cell_rows + 1;
+  sampler->reach_x = (int)spacing / sampler->cell_columns + 1;
+
+  const size_t cells =
+      (size_t)sampler->grid_rows * (size_t)sampler->grid_columns;
+  if (cells > sampler->cells) {
+    free(sampler->grid);
+    free(sampler->points);
+    free(sampler->active);
+    sampler->cells = cells;
+    sampler->grid = malloc(cells * sizeof(uint32_t));
+    sampler->points = malloc(cells * sizeof(SamplePoint));
+    sampler->active = malloc(cells * sizeof(uint32_t));
+    if (sampler->grid == NULL || sampler->points == NULL ||
+        sampler->active == NULL) {
+      sampler->cells = 0;
+      return 0;
+    }
+  }
+  memset(sampler->grid, 0, cells * sizeof(uint32_t));
+
+  size_t point_count = 0;
+  size_t active_count = 0;
+  SamplePoint point = {
+      .y = FrameThickness + (int)RandomBelow(&game->random, (uint32_t)rows),
+      .x = FrameThickness +
+           (int)RandomBelow(&game->random, (uint32_t)columns),
+  };
+  do {
+    *GetSampleCell(sampler, point) = (uint32_t)point_count + 1;
+    sampler->points[point_count] = point;
+    sampler->active[active_count++] = (uint32_t)point_count++;
+    bool found = false;
+    while (!found && active_count > 0) {
+      const uint32_t a = RandomBelow(&game->random, (uint32_t)active_count);
+      found = FindSample(game, sampler->points[sampler->active[a]], &point);
+      if (!found) {
+        sampler->active[a] = sampler->active[--active_count];
+      }
+    }
+  } while (active_count > 0);
+  return point_count;
+}
+
+static void SpreadItems(Game* game) {
+  PoissonSampler* sampler = &game->sampler;
+  const int rows = game->height - 2 * FrameThickness;
+  const int columns = GetSampleColumns(game);
+  // Two points on the same row are at least 2 apart, which is far enough
+  // for wide icons, and beyond `most`, there is only ever one point anyway.
+  const uint64_t most = 2 * (uint64_t)(rows + columns);
+  uint64_t least = (uint64_t)sampler->spacing;
+  least = least < 2 ? 2 : least > most ? most : least;
+  const uint64_t area = 2 * (uint64_t)rows * (uint64_t)columns;
+  uint64_t spacing = IntegerSquareRoot(area / (2 * game->item_count)) + 1;
+  spacing = spacing < least ? least : spacing > most ? most : spacing;
+  size_t point_count = FillWithSamples(game, spacing);
+  while (point_count < game->item_count && spacing > least) {
+    spacing = spacing * 3 / 4 > least ? spacing * 3 / 4 : least;
+    point_count = FillWithSamples(game, spacing);
+  }
+  if (point_count < game->item_count) {
+    for (size_t i = 0; i < game->item_count; ++i) {
+      PlaceItem(game, i);
+    }
+    return;
+  }
+
+  // Deal the points out at random.
+  for (size_t i = 0; i < game->item_count; ++i) {
+    const size_t j =
+        i + RandomBelow(&game->random, (uint32_t)(point_count - i));
+    const SamplePoint point = sampler->points[j];
+    sampler->points[j] = sampler->points[i];
+    Item* item = &game->items[i];
+    item->y = point.y;
+    item->x = point.x;
+    assert(SpanIsFree(game, item->y, item->x, GetItemWidth(item), SIZE_MAX));
+    AddItem(game, i);
+  }
+}
+
+// Sonar counts the items whose origins are within a radius of a cell, as
+// --fog measures it, optionally only in part of the field. The regions and
+// blocks wholly in range are counted from their summaries, and only the
+// blocks on the edge of the range cell by cell, from their origin bits, so a
+// ping costs about as much as the edge is long, however many items there
+// are.
+
+static Box IntersectBoxes(Box a, Box b) {
+  return (Box){.top = a.top > b.top ? a.top : b.top,
+               .left = a.left > b.left ? a.left : b.left,
+               .bottom = a.bottom < b.bottom ? a.bottom : b.bottom,
+               .right = a.right < b.right ? a.right : b.right};
+}
+
+static bool BoxIsEmpty(Box box) {
+  return box.top >= box.bottom || box.left >= box.right;
+}
+
+// Returns the squared distance from (y, x) to the nearest cell of the box,
+// or to the farthest.
+static int64_t GetBoxDistance(Box box, int y, int x, bool farthest) {
+  int64_t dy;
+  int64_t dx;
+  if (farthest) {
+    dy = y - box.top > box.bottom - 1 - y ? y - box.top : box.bottom - 1 - y;
+    dx = x - box.left > box.right - 1 - x ? x - box.left
+                                          : box.right - 1 - x;
+  } else {
+    dy = y < box.top ? box.top - y : y >= box.bottom ? y - box.bottom + 1 : 0;
+    dx = x < box.left ? box.left - x
+         : x >= box.right ? x - box.right + 1
+                          : 0;
+  }
+  return dy * dy + dx * dx;
+}
+
+typedef struct Sonar {
+  int y;
+  int x;
+  int64_t radius_squared;
+  // The part of the field to count in.
+  Box area;
+} Sonar;
+
+typedef enum Coverage {
+  CoverageNone,
+  CoveragePart,
+  CoverageAll,
+} Coverage;
+
+// Returns how much of the box, which must be within the field, the sonar
+// counts.
+static Coverage GetCoverage(const Sonar* sonar, Box box) {
+  const Box part = IntersectBoxes(box, sonar->area);
+  if (BoxIsEmpty(part) ||
+      GetBoxDistance(part, sonar->y, sonar->x, false) >
+          sonar->radius_squared) {
+    return CoverageNone;
+  }
+  if (part.top == box.top && part.left == box.left &&
+      part.bottom == box.bottom && part.right == box.right &&
+      GetBoxDistance(box, sonar->y, sonar->x, true) <=
+          sonar->radius_squared) {
+    return CoverageAll;
+  }
+  return CoveragePart;
+}
+
+// Counts the items in the block (by, bx) in range, from its origin bits.
+static uint64_t CountBlockOrigins(const Game* game, const Sonar* sonar,
+                                  int by, int bx) {
+  const Box part = IntersectBoxes(
+      (Box){.top = by << BlockShift,
+            .left = bx << BlockShift,
+            .bottom = (by + 1) << BlockShift,
+            .right = (bx + 1) << BlockShift},
+      sonar->area);
+  // The cells in range, as bits like the origins'. This is a fixed number
+  // of steps with no branches, which compilers can vectorize.
+  uint64_t mask = 0;
+  for (int y = part.top; y < part.bottom; ++y) {
+    const int64_t dy = y - sonar->y;
+    for (int x = part.left; x < part.right; ++x) {
+      const int64_t dx = x - sonar->x;
+      mask |= (uint64_t)(dy * dy + dx * dx <= sonar->radius_squared)
+              << ((y & (BlockSize - 1)) * BlockSize + (x & (BlockSize - 1)));
+    }
+  }
+  const size_t block = (size_t)by * (size_t)game->block_columns + (size_t)bx;
+  return (uint64_t)__builtin_popcountll(game->block_origins[block] & mask);
+}
+
+// Counts the items within `radius` of (y, x) that are in `area`.
+uint64_t CountItemsNear(const Game* game, int y, int x, int radius, Box area) {
+  const Box field = {.top = 0,
+                     .left = 0,
+                     .bottom = game->height,
+                     .right = game->width};
+  const Box range = {.top = y - radius,
+                     .left = x - radius,
+                     .bottom = y + radius + 1,
+                     .right = x + radius + 1};
+  const Sonar sonar = {
+      .y = y,
+      .x = x,
+      .radius_squared = (int64_t)radius * radius,
+      .area = IntersectBoxes(IntersectBoxes(area, range), field)};
+  if (BoxIsEmpty(sonar.area)) {
+    return 0;
+  }
+  const int region_shift = BlockShift + RegionShift;
+  uint64_t count = 0;
+  for (int ry = sonar.area.top >> region_shift;
+       ry <= (sonar.area.bottom - 1) >> region_shift; ++ry) {
+    for (int rx = sonar.area.left >> region_shift;
+         rx <= (sonar.area.right - 1) >> region_shift; ++rx) {
+      const Box region = IntersectBoxes(
+          (Box){.top = ry << region_shift,
+                .left = rx << region_shift,
+                .bottom = (ry + 1) << region_shift,
+                .right = (rx + 1) << region_shift},
+          field);
+      const Coverage coverage = GetCoverage(&sonar, region);
+      if (coverage == CoverageNone) {
+        continue;
+      }
+      if (coverage == CoverageAll) {
+        count += game->region_items[(size_t)ry *
+                                        (size_t)game->region_columns +
+                                    (size_t)rx];
+        continue;
+      }
+      const Box blocks = IntersectBoxes(region, sonar.area);
+      for (int by = blocks.top >> BlockShift;
+           by <= (blocks.bottom - 1) >> BlockShift; ++by) {
+        for (int bx = blocks.left >> BlockShift;
+             bx <= (blocks.right - 1) >> BlockShift; ++bx) {
+          const Box block = IntersectBoxes(
+              (Box){.top = by << BlockShift,
+                    .left = bx << BlockShift,
+                    .bottom = (by + 1) << BlockShift,
+                    .right = (bx + 1) << BlockShift},
+              field);
+          switch (GetCoverage(&sonar, block)) {
+            case CoverageAll:
+              count += game->block_items[(size_t)by *
+                                             (size_t)game->block_columns +
+                                         (size_t)bx];
+              break;
+            case CoveragePart:
+              count += CountBlockOrigins(game, &sonar, by, bx);
+              break;
+            case CoverageNone:
+              break;
+          }
+        }
+      }
+    }
+  }
+  return count;
+}
+
+// Starts a new game on the existing field: a new border color, a new
+// assignment of messages and icons to items, and new positions for all of
+// them. The same seed always produces the same game.
+void ResetGame(Game* game, uint64_t seed) {
+  game->seed = seed;
+  game->move_count = 0;
+  game->random.state = seed;
+  game->border_color = RandomBelow(&game->random, 6) + 1;
+  memset(game->occupancy, 0,
+         (size_t)game->width * (size_t)game->height * sizeof(uint32_t));
+  game->hash = 0;
+  ResetObstacles(game);
+  memset(game->touched, 0,
+         GetTouchedWords(game->item_count) * sizeof(uint64_t));
+  const size_t blocks =
+      (size_t)game->block_columns * (size_t)game->block_rows;
+  memset(game->block_items, 0, blocks * sizeof(uint32_t));
+  memset(game->block_touched, 0, blocks * sizeof(uint32_t));
+  memset(game->block_visits, 0, blocks * sizeof(uint32_t));
+  memset(game->block_origins, 0, blocks * sizeof(uint64_t));
+  memset(game->region_items, 0,
+         (size_t)game->region_columns * (size_t)game->region_rows *
+             sizeof(uint32_t));
+
+  // Shuffle only the messages after the Robot and Kitten placeholders:
+  assert(StringsEqual("", Messages[Robot]));
+  assert(StringsEqual("", Messages[Kitten]));
+  const size_t message_count = COUNT(Messages) - Bogus;
+  for (size_t i = 0; i < message_count; ++i) {
+    game->order[i] = (uint32_t)(Bogus + i);
+  }
+  Shuffle(game->order, message_count, &game->random);
+  game->items[Robot].message = (uint32_t)Robot;
+  game->items[Kitten].message = (uint32_t)Kitten;
+  for (size_t i = Bogus; i < game->item_count; ++i) {
+    game->items[i].message = game->order[(i - Bogus) % message_count];
+  }
+
+  for (size_t i = 0; i < COUNT(Icons); ++i) {
+    game->order[i] = (uint32_t)i;
+  }
+  Shuffle(game->order, COUNT(Icons), &game->random);
+  game->items[Robot].icon = RobotIconIndex;
+  for (size_t i = Kitten; i < game->item_count; ++i) {
+    game->items[i].icon = game->order[(i - Kitten) % COUNT(Icons)];
+  }
+  if (game->sampler.spacing > 0) {
+    SpreadItems(game);
+  } else {
+    for (size_t i = 0; i < game->item_count; ++i) {
+      PlaceItem(game, i);
+    }
+  }
+  ResetDerivedState(game);
+}
+
+// Changes the size of the field, keeping every item where it is. Returns
+// false, leaving the game unchanged, if some item would be off the new field.
+bool ResizeField(Game* game, int width, int height) {
+  for (size_t i = 0; i < game->item_count; ++i) {
+    const Item* item = &game->items[i];
+    if (item->x + GetItemWidth(item) > width - FrameThickness ||
+        item->y >= height - FrameThickness) {
+      return false;
+    }
+  }
+  // Keep the visits of the blocks that are on both fields.
+  uint32_t* visits = game->block_visits;
+  const int block_columns = game->block_columns;
+  const int block_rows = game->block_rows;
+  game->block_visits = NULL;
+  if (!AllocateField(game, width, height)) {
+    free(visits);
+    return false;
+  }
+  for (int y = 0; y < block_rows && y < game->block_rows; ++y) {
+    for (int x = 0; x < block_columns && x < game->block_columns; ++x) {
+      game->block_visits[(size_t)y * (size_t)game->block_columns +
+                         (size_t)x] =
+          visits[(size_t)y * (size_t)block_columns + (size_t)x];
+    }
+  }
+  free(visits);
+  for (size_t i = 0; i < game->item_count; ++i) {
+    AddItem(game, i);
+  }
+  ResetDerivedState(game);
+  return true;
+}
+
+// A saved game is a Snapshot, items and all, then the touched bits, laid out
+// as they are in memory, so that RestoreGame can map the file and use it in
+// place. The layout is this machine's; the magic number and the sizes keep a
+// file from another kind of machine, or another version, from being misread.
+enum { SnapshotMagic = 0x6b667273, SnapshotVersion = 2 };
+
+typedef struct Snapshot {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t header_size;
+  uint32_t item_size;
+  uint64_t seed;
+  uint64_t random_state;
+  uint64_t item_count;
+  int32_t width;
+  int32_t height;
+  uint32_t border_color;
+  uint32_t reserved;
+  // The game's hash, which the restored game must have too.
+  uint64_t hash;
+  Item items[];
+} Snapshot;
+
+static_assert(sizeof(Snapshot) % sizeof(uint64_t) == 0 &&
+                  sizeof(Item) * 2 % sizeof(uint64_t) == 0,
+              "The touched bits after the items must be aligned");
+
+static size_t GetSnapshotSize(size_t item_count) {
+  return sizeof(Snapshot) + item_count * sizeof(Item) +
+         GetTouchedWords(item_count) * sizeof(uint64_t);
+}
+
+// Writes the game to `path`, by way of a temporary file, so that a crash
+// never leaves half a snapshot. Returns false if it cannot.
+bool SaveGame(const Game* game, const char* path) {
+  char temporary[4096];
+  const int length = snprintf(temporary, sizeof(temporary), "%s.new", path);
+  if (length < 0 || (size_t)length >= sizeof(temporary)) {
+    return false;
+  }
+  FILE* file = fopen(temporary, "wb");
+  if (file == NULL) {
+    return false;
+  }
+  const Snapshot snapshot = {
+      .magic = SnapshotMagic,
+      .version = SnapshotVersion,
+      .header_size = sizeof(Snapshot),
+      .item_size = sizeof(Item),
+      .seed = game->seed,
+      .random_state = game->random.state,
+      .item_count = game->item_count,
+      .width = game->width,
+      .height = game->height,
+      .border_color = game->border_color,
+      .hash = game->hash,
+  };
+  const size_t words = GetTouchedWords(game->item_count);
+  bool saved =
+      fwrite(&snapshot, sizeof(snapshot), 1, file) == 1 &&
+      fwrite(game->items, sizeof(Item), game->item_count, file) ==
+          game->item_count &&
+      fwrite(game->touched, sizeof(uint64_t), words, file) == words &&
+      fflush(file) == 0;
+  if (saved) {
+    SyncFile(fileno(file));
+  }
+  saved = fclose(file) == 0 && saved;
+  if (!saved || rename(temporary, path) != 0) {
+    unlink(temporary);
+    return false;
+  }
+  return true;
+}
+
+// Restores a game saved by SaveGame. The file is mapped privately, and the
+// game uses its items and touched bits where they are, so that restoring
+// even a huge field takes one mmap and one pass over the items, to check
+// them and put them on the field. The caller sets the game's rules, and
+// then calls ResetDerivedState. Returns false if the file cannot be read, or
+// is not a snapshot of a possible game.
+bool RestoreGame(Game* game, const char* path) {
+  memset(game, 0, sizeof(*game));
+  const int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat status;
+  const bool has_header = fstat(fd, &status) == 0 &&
+                          status.st_size >= (off_t)sizeof(Snapshot);
+  void* mapping = has_header ? mmap(NULL, (size_t)status.st_size,
+                                    PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0)
+                             : MAP_FAILED;
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    return false;
+  }
+  game->snapshot = mapping;
+  game->snapshot_size = (size_t)status.st_size;
+  Snapshot* snapshot = mapping;
+  if (snapshot->magic != SnapshotMagic ||
+      snapshot->version != SnapshotVersion ||
+      snapshot->header_size != sizeof(Snapshot) ||
+      snapshot->item_size != sizeof(Item) || snapshot->item_count < Bogus ||
+      snapshot->item_count > game->snapshot_size / sizeof(Item) ||
+      GetSnapshotSize(snapshot->item_count) != game->snapshot_size ||
+      snapshot->border_color - 1 >= 6 ||
+      !FieldCanHold(snapshot->width, snapshot->height,
+                    snapshot->item_count)) {
+    DestroyGame(game);
+    return false;
+  }
+  game->seed = snapshot->seed;
+  game->random.state = snapshot->random_state;
+  game->border_color = snapshot->border_color;
+  game->item_count = game->item_capacity = snapshot->item_count;
+  game->items = snapshot->items;
+  game->touched = (void*)&snapshot->items[snapshot->item_count];
+  if (!AllocateScratch(game) ||
+      !AllocateField(game, snapshot->width, snapshot->height)) {
+    DestroyGame(game);
+    return false;
+  }
+  for (size_t i = 0; i < game->item_count; ++i) {
+    const Item* item = &game->items[i];
+    // The icon must be checked before its width is looked up.
+    if ((i == Robot) != (item->icon == RobotIconIndex) || !ItemIsValid(item)) {
+      DestroyGame(game);
+      return false;
+    }
+    const int width = GetItemWidth(item);
+    if (!IsInside(game, item->y, item->x, width) ||
+        !SpanIsFree(game, item->y, item->x, width, SIZE_MAX)) {
+      DestroyGame(game);
+      return false;
+    }
+    AddItem(game, i);
+  }
+  if (game->hash != snapshot->hash) {
+    DestroyGame(game);
+    return false;
+  }
+  return true;
+}
+
+// Tests what Robot would touch if it moved to (y, x). Robot is wide, so it
+// touches whatever covers any of the cells it would cover.
+static TouchTestResult TouchTest(const Game* game, int y, int x,
+                                 size_t* item_number) {
+  const Item* robot = &game->items[Robot];
+  if (robot->y == y && robot->x == x) {
+    *item_number = Robot;
+    return TouchTestResultRobot;
+  }
+  for (int i = 0; i < GetItemWidth(robot); ++i) {
+    const uint32_t occupant = GetOccupant(game, y, x + i);
+    if (occupant == 0 || occupant - 1 == Robot) {
+      continue;
+    }
+    *item_number = occupant - 1;
+    return *item_number == Kitten ? TouchTestResultKitten
+                                  : TouchTestResultNonKitten;
+  }
+  return TouchTestResultNone;
+}
+
+// Tries to move Robot to (y, x). If there is an item there, Robot touches it
+// instead of moving. If `first_touch` is not NULL, it says whether Robot had
+// not touched the item before.
+TouchTestResult MoveRobot(Game* game, int y, int x, size_t* item_number,
+                          bool* first_touch) {
+  // It's the edge of the world as we know it...
+  if (!IsInside(game, y, x, GetItemWidth(&game->items[Robot]))) {
+    return TouchTestResultEdge;
+  }
+  const TouchTestResult result = TouchTest(game, y, x, item_number);
+  switch (result) {
+    case TouchTestResultNone:
+      Vacate(game, Robot);
+      game->items[Robot].y = y;
+      game->items[Robot].x = x;
+      Occupy(game, Robot);
+      ++game->block_visits[GetBlockIndex(game, y, x)];
+      if (game->sight.radius > 0) {
+        UpdateFieldOfView(game, AllOctants);
+      }
+      break;
+    case TouchTestResultKitten:
+    case TouchTestResultNonKitten:
+      if (first_touch != NULL) {
+        *first_touch = !IsTouched(game, *item_number);
+      }
+      MarkTouched(game, *item_number);
+      break;
+    case TouchTestResultRobot:
+    case TouchTestResultEdge:
+      break;
+  }
+  return result;
+}
+
+// Advances the simulation by one tick. If the items wander, each non-kitten
+// item takes a step in a random direction about half the time, if the cells
+// it would move into are free. If Kitten evades, it then steps away from
+// Robot. The moves are recorded in game->moves, so that the caller can
+// repaint just the cells that changed. This runs every few milliseconds over
+// possibly many thousands of items, so it walks the items in order, draws
+// one random number per item, and allocates nothing.
+void TickGame(Game* game) {
+  game->move_count = 0;
+  for (size_t i = Bogus; game->items_wander && i < game->item_count; ++i) {
+    const uint64_t random = NextRandom(&game->random);
+    if (random & 1) {
+      continue;
+    }
+    Item* item = &game->items[i];
+    const int width = GetItemWidth(item);
+    const Direction d = (Direction)((random >> 1) % DirectionCount);
+    const int y = item->y + Steps[d].dy;
+    const int x = item->x + Steps[d].dx;
+    if (!IsInside(game, y, x, width) || !SpanIsFree(game, y, x, width, i)) {
+      continue;
+    }
+    game->moves[game->move_count++] =
+        (ItemMove){.item = (uint32_t)i, .x = item->x, .y = item->y};
+    Vacate(game, i);
+    CountInBlock(game, i, false);
+    const int old_y = item->y;
+    const int old_x = item->x;
+    item->y = y;
+    item->x = x;
+    CountInBlock(game, i, true);
+    Occupy(game, i);
+    if (game->kitten_evades) {
+      UpdateDistanceField(game, old_y, old_x, width);
+      UpdateDistanceField(game, y, x, width);
+    }
+  }
+  if (game->kitten_evades) {
+    MoveKitten(game);
+  }
+  if (game->move_count > 0) {
+    game->kitten_distances.stale = true;
+  }
+  if (game->sight.radius > 0) {
+    UpdateSightForMoves(game);
+  }
+}
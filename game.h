@@ -0,0 +1,367 @@
+// The state of one game of robotfindskitten, and the rules it is played by,
+// independent of curses: the field and its items, moving Robot and touching
+// things, the ticks on which the other items move, --hard, --fog,
+// --spacing, sonar, and snapshots.
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+
+#ifndef GAME_H
+#define GAME_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define CONTROL(key) ((key)&0x1f)
+
+#define COUNT(a) (sizeof((a)) / sizeof((a)[0]))
+
+// The keys that play the game. --protocol takes the NetHack movement keys as
+// moves, too.
+typedef enum KeyCode {
+  NetHack_down = 'j',
+  NetHack_DOWN = 'J',
+  NetHack_up = 'k',
+  NetHack_UP = 'K',
+  NetHack_left = 'h',
+  NetHack_LEFT = 'H',
+  NetHack_right = 'l',
+  NetHack_RIGHT = 'L',
+  NetHack_up_left = 'y',
+  NetHack_UP_LEFT = 'Y',
+  NetHack_up_right = 'u',
+  NetHack_UP_RIGHT = 'U',
+  NetHack_down_left = 'b',
+  NetHack_DOWN_LEFT = 'B',
+  NetHack_down_right = 'n',
+  NetHack_DOWN_RIGHT = 'N',
+
+  NumLock_UP_LEFT = '7',
+  NumLock_UP = '8',
+  NumLock_UP_RIGHT = '9',
+  NumLock_LEFT = '4',
+  NumLock_RIGHT = '6',
+  NumLock_DOWN_LEFT = '1',
+  NumLock_DOWN = '2',
+  NumLock_DOWN_RIGHT = '3',
+
+  Emacs_NEXT = CONTROL('N'),
+  Emacs_PREVIOUS = CONTROL('P'),
+  Emacs_BACKWARD = CONTROL('B'),
+  Emacs_FORWARD = CONTROL('F'),
+
+  Key_RedrawScreen = CONTROL('L'),
+  Key_hint = 'w',
+  Key_HINT = 'W',
+  Key_quit = 'q',
+  Key_QUIT = 'Q',
+  Key_save = 's',
+  Key_SAVE = 'S',
+  Key_restart = 'r',
+  Key_RESTART = 'R',
+  Key_minimap = 'm',
+  Key_MINIMAP = 'M',
+  Key_sonar = 'p',
+  Key_SONAR = 'P',
+} KeyCode;
+
+static const int FrameThickness = 1;
+
+// Items are plain data, so that a whole field can be copied, shared, or saved
+// as it is. `icon` indexes Icons (or is RobotIconIndex), and `message`
+// indexes Messages.
+typedef struct Item {
+  int32_t x;
+  int32_t y;
+  uint32_t icon;
+  uint32_t message;
+} Item;
+
+// Special indices in the Game.items array.
+static const size_t Robot = 0;
+static const size_t Kitten = 1;
+static const size_t Bogus = 2;
+
+// SplitMix64. We use our own generator rather than random(), so that a seed
+// produces the same field on every platform, and so that each Game can have
+// its own.
+typedef struct Random {
+  uint64_t state;
+} Random;
+
+// The field is divided into blocks of BlockSize × BlockSize cells, each of
+// which keeps a count of the items whose origin is in it, how many of those
+// Robot has touched, and how many of Robot's moves have ended in it, and a
+// bit per cell for whether an item's origin is there. The blocks are grouped
+// in turn into regions of RegionSize × RegionSize blocks, each of which
+// keeps a count of the items whose origin is in it. Robot is in none of
+// these.
+enum {
+  BlockShift = 3,
+  BlockSize = 1 << BlockShift,
+  RegionShift = 3,
+  RegionSize = 1 << RegionShift,
+};
+
+typedef struct ItemMove {
+  uint32_t item;
+  int32_t x;
+  int32_t y;
+} ItemMove;
+
+// A binary min-heap of cells, numbered as in Game.occupancy, by 64-bit key.
+// `index` holds each cell's position in the heap, plus 1, or 0 if it is not
+// in it, so that a cell's key can be changed in place.
+typedef struct CellHeap {
+  uint32_t* cells;
+  uint64_t* keys;
+  uint32_t* index;
+  size_t size;
+} CellHeap;
+
+// With --hard, Kitten hears Robot coming from this many steps away.
+static const uint32_t EarshotRange = 24;
+
+// Path distances from Robot, which Kitten runs from with --hard.
+typedef struct DistanceField {
+  size_t cells;
+  uint32_t* g;
+  uint32_t* rhs;
+  // The cells whose g and rhs differ.
+  CellHeap queue;
+  uint32_t km;
+  // Robot's cell, which the distances are from, and Kitten's, which the
+  // search is focused on.
+  uint32_t source;
+  uint32_t start;
+  int start_y;
+  int start_x;
+} DistanceField;
+
+// Reusable state for finding paths for Robot; see FindPath.
+typedef struct PathFinder {
+  size_t cells;
+  uint32_t* cost;
+  uint32_t* parent;
+  // A cell's cost and parent are valid if its generation is this search's
+  // open or closed generation.
+  uint32_t* generations;
+  uint32_t generation;
+  CellHeap open;
+  uint32_t goal;
+  int goal_y;
+  int goal_x;
+  int width;
+  // The path found, as jump points.
+  uint32_t* path;
+  size_t path_length;
+} PathFinder;
+
+// Path distances to Kitten, for the hint key; see ComputeKittenDistances.
+typedef struct DistanceTransform {
+  size_t cells;
+  uint32_t* distances;
+  uint32_t* queue;
+  bool stale;
+} DistanceTransform;
+
+// What Robot can see with --fog; see UpdateFieldOfView.
+typedef struct FieldOfView {
+  // 0 if there is no fog.
+  int radius;
+  size_t cells;
+  // Per cell: a bit for each octant around Robot that sees the cell, then
+  // SeenFlag and ListedFlag.
+  uint16_t* flags;
+  // Where the octants were cast from.
+  int origin_y;
+  int origin_x;
+  // The cells that came into or went out of sight in the last update.
+  uint32_t* changes;
+  size_t change_count;
+} FieldOfView;
+
+typedef struct SamplePoint {
+  int32_t y;
+  int32_t x;
+} SamplePoint;
+
+// Where items can go with --spacing; see SpreadItems.
+typedef struct PoissonSampler {
+  // The least distance between items, in columns, counting a row as two
+  // columns; 0 if items are placed uniformly.
+  int spacing;
+  // The spacing of the last fill, which may be more than `spacing`.
+  uint64_t distance;
+  uint64_t spacing_squared;
+  // The background grid, which has a cell for every cell_rows ×
+  // cell_columns cells of the field's interior, holding the number of the
+  // point in it, plus 1, or 0. A point closer than the spacing to another is
+  // at most reach_y rows and reach_x columns of grid cells away from it.
+  size_t cells;
+  uint32_t* grid;
+  int grid_rows;
+  int grid_columns;
+  int cell_rows;
+  int cell_columns;
+  int reach_y;
+  int reach_x;
+  SamplePoint* points;
+  // The points that new points may still be tried around.
+  uint32_t* active;
+} PoissonSampler;
+
+// The state of one game, independent of curses.
+typedef struct Game {
+  // The size of the field in cells, including the frame. Items live in the
+  // interior, x in [1, width - 2] and y in [1, height - 2].
+  int width;
+  int height;
+  uint64_t seed;
+  Random random;
+  unsigned int border_color;
+
+  // Robot, Kitten, and then the non-kitten items. `items`, `touched`, and
+  // `moves` have room for `item_capacity` items, so that a later round can
+  // have more; see ReserveItems.
+  Item* items;
+  size_t item_count;
+  size_t item_capacity;
+
+  // Maps each cell to the item covering it (index + 1), or 0 if the cell is
+  // empty. A wide icon covers every cell it takes up.
+  uint32_t* occupancy;
+
+  // Bit i is set once Robot has touched item i.
+  uint64_t* touched;
+
+  // A Zobrist hash of where the items are, and which Robot has touched; see
+  // GetItemKey.
+  uint64_t hash;
+
+  // If the game was restored, the snapshot file, mapped privately, which
+  // `items` and `touched` point into; see RestoreGame.
+  void* snapshot;
+  size_t snapshot_size;
+
+  int block_columns;
+  int block_rows;
+  uint32_t* block_items;
+  uint32_t* block_touched;
+  uint32_t* block_visits;
+  uint64_t* block_origins;
+  int region_columns;
+  int region_rows;
+  uint32_t* region_items;
+
+  // Bitmaps of the cells Robot cannot go into: the frame, and every item
+  // but Robot. Row y's words hold bit x for cell (y, x), and column x's
+  // words hold bit y; the bits past the end of each row and column are set
+  // too. The path finder scans these 64 cells at a time.
+  int row_words;
+  int column_words;
+  uint64_t* row_obstacles;
+  uint64_t* column_obstacles;
+
+  // Scratch space for shuffling the messages and icons.
+  uint32_t* order;
+
+  // The items that moved in the last tick, and where they were before.
+  ItemMove* moves;
+  size_t move_count;
+
+  // What happens on each tick: whether the non-kitten items wander, and
+  // whether Kitten runs from Robot.
+  bool items_wander;
+  bool kitten_evades;
+  DistanceField distance;
+
+  DistanceTransform kitten_distances;
+  PathFinder paths;
+  FieldOfView sight;
+  PoissonSampler sampler;
+} Game;
+
+// The 8 directions things can move in, in clockwise order, so that turning
+// is adding to a Direction.
+typedef enum Direction {
+  DirectionUp,
+  DirectionUpRight,
+  DirectionRight,
+  DirectionDownRight,
+  DirectionDown,
+  DirectionDownLeft,
+  DirectionLeft,
+  DirectionUpLeft,
+  DirectionCount,
+} Direction;
+
+static const struct {
+  int dy;
+  int dx;
+} Steps[DirectionCount] = {
+    {-1, 0}, {-1, 1}, {0, 1}, {1, 1}, {1, 0}, {1, -1}, {0, -1}, {-1, -1},
+};
+
+// The distance to a cell that cannot be reached.
+static const uint32_t Infinity = UINT32_MAX;
+
+// Rows [top, bottom) and columns [left, right).
+typedef struct Box {
+  int top;
+  int left;
+  int bottom;
+  int right;
+} Box;
+
+typedef enum TouchTestResult {
+  TouchTestResultNone,
+  TouchTestResultRobot,
+  TouchTestResultKitten,
+  TouchTestResultNonKitten,
+  TouchTestResultEdge,
+} TouchTestResult;
+
+extern char RobotIcon[];
+
+bool StringsEqual(const char* a, const char* b);
+uint64_t MixBits(uint64_t z);
+uint64_t NextRandom(Random* random);
+uint32_t RandomBelow(Random* random, uint32_t n);
+int GetDisplayWidth(const char* s);
+void MeasureIcons(void);
+const char* GetIcon(const Item* item);
+int GetItemWidth(const Item* item);
+const char* GetMessage(const Item* item);
+bool ItemIsValid(const Item* item);
+size_t GetCellIndex(const Game* game, int y, int x);
+uint32_t GetOccupant(const Game* game, int y, int x);
+bool IsTouched(const Game* game, size_t item_number);
+void QueueCell(CellHeap* heap, uint32_t cell, uint64_t key);
+void DequeueCell(CellHeap* heap, uint32_t cell);
+void ClearCellHeap(CellHeap* heap);
+void FreeCellHeap(CellHeap* heap);
+bool AllocateCellHeap(CellHeap* heap, size_t cells);
+size_t GetFieldCapacity(int width, int height);
+bool FieldCanHold(int width, int height, size_t item_count);
+void FreePathFinder(PathFinder* finder);
+void DestroyGame(Game* game);
+bool CreateGame(Game* game, int width, int height, size_t non_kitten_count);
+bool ReserveItems(Game* game, size_t capacity);
+bool IsInside(const Game* game, int y, int x, int width);
+uint32_t GetKittenDistance(Game* game);
+bool ItemIsSeen(const Game* game, const Item* item);
+void ResetDerivedState(Game* game);
+uint64_t CountItemsNear(const Game* game, int y, int x, int radius, Box area);
+void ResetGame(Game* game, uint64_t seed);
+bool ResizeField(Game* game, int width, int height);
+bool SaveGame(const Game* game, const char* path);
+bool RestoreGame(Game* game, const char* path);
+TouchTestResult MoveRobot(Game* game, int y, int x, size_t* item_number,
+                          bool* first_touch);
+void TickGame(Game* game);
+
+#endif  // GAME_H
@@ -0,0 +1,359 @@
+// This program is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+
+#define _DARWIN_C_SOURCE
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 700
+#define _XOPEN_SOURCE_EXTENDED
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "game.h"
+#include "path.h"
+
+int Sign(int n) {
+  return (n > 0) - (n < 0);
+}
+
+Direction GetDirection(int dy, int dx) {
+  for (int d = 0; d < DirectionCount; ++d) {
+    if (Steps[d].dy == Sign(dy) && Steps[d].dx == Sign(dx)) {
+      return (Direction)d;
+    }
+  }
+  return DirectionUp;
+}
+
+// Clicking on the field sends Robot there along a shortest path around the
+// items, found with A* and jump point search. Diagonal steps cost
+// DiagonalCost and straight ones StraightCost, about √2 to 1, which both
+// makes paths look natural (diagonals first, not zigzags) and is what jump
+// point search's pruning rules assume. A position is a cell where Robot's
+// left end can stand, so Robot's width is accounted for, and Robot may cut
+// corners, as it can with the keys. The arrays are kept from one search to
+// the next, and a generation count says which entries belong to this one,
+// so a search touches only the cells it visits.
+
+// Returns true if Robot could stand at (y, x) on its way to `goal`, the one
+// position it may reach by touching an item.
+// This is the innermost test of the search, so it reads the occupancy grid
+// directly.
+static bool CanStand(const PathFinder* finder, const Game* game, int y, int x) {
+  if (!IsInside(game, y, x, finder->width)) {
+    return false;
+  }
+  const size_t cell = (size_t)y * (size_t)game->width + (size_t)x;
+  for (int i = 0; i < finder->width; ++i) {
+    const uint32_t occupant = game->occupancy[cell + (size_t)i];
+    if (occupant != 0 && occupant - 1 != Robot) {
+      return cell == finder->goal;
+    }
+  }
+  return true;
+}
+
+static uint32_t GetPathCost(int dy, int dx) {
+  dy = abs(dy);
+  dx = abs(dx);
+  const int diagonal = dy < dx ? dy : dx;
+  const int straight = (dy > dx ? dy : dx) - diagonal;
+  return (uint32_t)(diagonal * DiagonalCost + straight * StraightCost);
+}
+
+// Returns the positions Robot cannot stand at among 64 along a line: bit i
+// is for position k * 64 + i of row `line`, or of column `line` if
+// `vertical`. Positions past the end of the line are blocked, and the goal
+// is not.
+static uint64_t GetLineBlocks(const PathFinder* finder, const Game* game,
+                              bool vertical, int line, int k) {
+  const int words = vertical ? game->column_words : game->row_words;
+  if (k < 0 || k >= words) {
+    return UINT64_MAX;
+  }
+  uint64_t blocks;
+  if (vertical) {
+    // Robot's icon covers `width` columns.
+    blocks = 0;
+    for (int i = 0; i < finder->width; ++i) {
+      blocks |= game->column_obstacles[(size_t)(line + i) * (size_t)words +
+                                       (size_t)k];
+    }
+  } else {
+    const uint64_t* row = &game->row_obstacles[(size_t)line * (size_t)words];
+    const uint64_t next = k + 1 < words ? row[k + 1] : UINT64_MAX;
+    blocks = row[k];
+    for (int i = 1; i < finder->width; ++i) {
+      blocks |= row[k] >> i | next << (64 - i);
+    }
+  }
+  const int goal_line = vertical ? finder->goal_x : finder->goal_y;
+  const int goal_position = vertical ? finder->goal_y : finder->goal_x;
+  if (line == goal_line && goal_position >> 6 == k) {
+    blocks &= ~((uint64_t)1 << (goal_position & 63));
+  }
+  return blocks;
+}
+
+// Returns the positions along the line next to which Robot, going in
+// direction `step` along the line beside it, is forced to turn: those that
+// are blocked on `line` but the next in that direction is not.
+static uint64_t GetForcedTurns(const PathFinder* finder, const Game* game,
+                               bool vertical, int line, int k, int step) {
+  const uint64_t blocks = GetLineBlocks(finder, game, vertical, line, k);
+  const uint64_t next =
+      step > 0 ? blocks >> 1 |
+                     GetLineBlocks(finder, game, vertical, line, k + 1) << 63
+               : blocks << 1 |
+                     GetLineBlocks(finder, game, vertical, line, k - 1) >> 63;
+  return blocks & ~next;
+}
+
+// Goes along row `line` (or column, if `vertical`) from position `from` in
+// direction `step`, as Jump does for straight moves, but 64 positions at a
+// time. Returns the position of the jump point, or -1 if there is none.
+static int ScanLine(const PathFinder* finder, const Game* game, bool vertical,
+                    int line, int from, int step) {
+  const int goal_line = vertical ? finder->goal_x : finder->goal_y;
+  const int goal_position = vertical ? finder->goal_y : finder->goal_x;
+  int position = from + step;
+  while (true) {
+    const int k = position >> 6;
+    const uint64_t blocks = GetLineBlocks(finder, game, vertical, line, k);
+    uint64_t stops =
+        blocks |
+        GetForcedTurns(finder, game, vertical, line - 1, k, step) |
+        GetForcedTurns(finder, game, vertical, line + 1, k, step);
+    if (line == goal_line && goal_position >> 6 == k) {
+      stops |= (uint64_t)1 << (goal_position & 63);
+    }
+    // Only the positions from `position` on count.
+    const int bit = position & 63;
+    stops &= step > 0 ? UINT64_MAX << bit : UINT64_MAX >> (63 - bit);
+    if (stops != 0) {
+      const int stop = k * 64 + (step > 0 ? __builtin_ctzll(stops)
+                                          : 63 - __builtin_clzll(stops));
+      return blocks >> (stop & 63) & 1 ? -1 : stop;
+    }
+    position = step > 0 ? (k + 1) * 64 : k * 64 - 1;
+  }
+}
+
+// Steps from (*y, *x) in direction (dy, dx) until reaching a jump point: the
+// goal, or a position where a shortest path may have to turn. Returns false
+// if there is none before Robot would run into something.
+static bool Jump(const PathFinder* finder, const Game* game, int* y, int* x,
+                 int dy, int dx) {
+  if (dy == 0 || dx == 0) {
+    const int stop = dy == 0 ? ScanLine(finder, game, false, *y, *x, dx)
+                             : ScanLine(finder, game, true, *x, *y, dy);
+    if (stop < 0) {
+      return false;
+    }
+    *(dy == 0 ? x : y) = stop;
+    return true;
+  }
+  int j = *y;
+  int i = *x;
+  while (true) {
+    j += dy;
+    i += dx;
+    if (!CanStand(finder, game, j, i)) {
+      return false;
+    }
+    if (j == finder->goal_y && i == finder->goal_x) {
+      break;
+    }
+    if ((!CanStand(finder, game, j, i - dx) &&
+         CanStand(finder, game, j + dy, i - dx)) ||
+        (!CanStand(finder, game, j - dy, i) &&
+         CanStand(finder, game, j - dy, i + dx))) {
+      break;
+    }
+    // A diagonal move also stops where a straight one would find something.
+    if (ScanLine(finder, game, false, j, i, dx) >= 0 ||
+        ScanLine(finder, game, true, i, j, dy) >= 0) {
+      break;
+    }
+  }
+  *y = j;
+  *x = i;
+  return true;
+}
+
+// Returns the directions worth searching from (y, x), having arrived there
+// going in direction (dy, dx): straight on, and any turns that going around
+// an item forces. A bit is set for each Direction.
+static unsigned int GetJumpDirections(const PathFinder* finder,
+                                      const Game* game, int y, int x, int dy,
+                                      int dx) {
+  if (dy == 0 && dx == 0) {
+    return (1u << DirectionCount) - 1;
+  }
+  unsigned int directions = 1u << GetDirection(dy, dx);
+  if (dy != 0 && dx != 0) {
+    directions |= 1u << GetDirection(0, dx) | 1u << GetDirection(dy, 0);
+    if (!CanStand(finder, game, y, x - dx)) {
+      directions |= 1u << GetDirection(dy, -dx);
+    }
+    if (!CanStand(finder, game, y - dy, x)) {
+      directions |= 1u << GetDirection(-dy, dx);
+    }
+  } else if (dx != 0) {
+    if (!CanStand(finder, game, y - 1, x)) {
+      directions |= 1u << GetDirection(-1, dx);
+    }
+    if (!CanStand(finder, game, y + 1, x)) {
+      directions |= 1u << GetDirection(1, dx);
+    }
+  } else {
+    if (!CanStand(finder, game, y, x - 1)) {
+      directions |= 1u << GetDirection(dy, -1);
+    }
+    if (!CanStand(finder, game, y, x + 1)) {
+      directions |= 1u << GetDirection(dy, 1);
+    }
+  }
+  return directions;
+}
+
+// Makes sure the finder's arrays fit the field, and starts a new generation.
+static bool PreparePathFinder(PathFinder* finder, const Game* game) {
+  const size_t cells = (size_t)game->width * (size_t)game->height;
+  if (cells != finder->cells) {
+    free(finder->cost);
+    free(finder->parent);
+    free(finder->generations);
+    free(finder->path);
+    finder->cells = cells;
+    finder->cost = malloc(cells * sizeof(uint32_t));
+    finder->parent = malloc(cells * sizeof(uint32_t));
+    finder->generations = calloc(cells, sizeof(uint32_t));
+    finder->path = malloc(cells * sizeof(uint32_t));
+    finder->generation = 0;
+    if (finder->cost == NULL || finder->parent == NULL ||
+        finder->generations == NULL || finder->path == NULL ||
+        !AllocateCellHeap(&finder->open, cells)) {
+      finder->cells = 0;
+      return false;
+    }
+  }
+  ClearCellHeap(&finder->open);
+  // Each generation takes two values: one for open and one for closed.
+  finder->generation += 2;
+  if (finder->generation < 2) {
+    memset(finder->generations, 0, cells * sizeof(uint32_t));
+    finder->generation = 2;
+  }
+  return true;
+}
+
+// Finds a shortest path for Robot to (y, x). If there is one, fills in
+// finder->path with the jump points along it, from the first after Robot's
+// position to (y, x), and returns true.
+bool FindPath(PathFinder* finder, const Game* game, int y, int x) {
+  finder->path_length = 0;
+  const Item* robot = &game->items[Robot];
+  finder->width = GetItemWidth(robot);
+  if (!IsInside(game, y, x, finder->width) ||
+      !PreparePathFinder(finder, game)) {
+    return false;
+  }
+  finder->goal = (uint32_t)GetCellIndex(game, y, x);
+  finder->goal_y = y;
+  finder->goal_x = x;
+  const uint32_t open = finder->generation;
+  const uint32_t closed = finder->generation + 1;
+  const uint32_t start = (uint32_t)GetCellIndex(game, robot->y, robot->x);
+  finder->cost[start] = 0;
+  finder->parent[start] = start;
+  finder->generations[start] = open;
+  QueueCell(&finder->open, start, (uint64_t)GetPathCost(y - robot->y,
+                                                        x - robot->x) << 32);
+  const uint32_t width = (uint32_t)game->width;
+  while (finder->open.size > 0) {
+    const uint32_t cell = finder->open.cells[0];
+    DequeueCell(&finder->open, cell);
+    finder->generations[cell] = closed;
+    if (cell == finder->goal) {
+      break;
+    }
+    const int cell_y = (int)(cell / width);
+    const int cell_x = (int)(cell % width);
+    const uint32_t parent = finder->parent[cell];
+    const unsigned int directions = GetJumpDirections(
+        finder, game, cell_y, cell_x, Sign(cell_y - (int)(parent / width)),
+        Sign(cell_x - (int)(parent % width)));
+    for (int d = 0; d < DirectionCount; ++d) {
+      int jump_y = cell_y;
+      int jump_x = cell_x;
+      if (!(directions & 1u << d) ||
+          !Jump(finder, game, &jump_y, &jump_x, Steps[d].dy, Steps[d].dx)) {
+        continue;
+      }
+      const uint32_t jump = (uint32_t)GetCellIndex(game, jump_y, jump_x);
+      if (finder->generations[jump] == closed) {
+        continue;
+      }
+      const uint32_t cost =
+          finder->cost[cell] + GetPathCost(jump_y - cell_y, jump_x - cell_x);
+      if (finder->generations[jump] == open && cost >= finder->cost[jump]) {
+        continue;
+      }
+      finder->cost[jump] = cost;
+      finder->parent[jump] = cell;
+      finder->generations[jump] = open;
+      QueueCell(&finder->open, jump,
+                (uint64_t)(cost + GetPathCost(y - jump_y, x - jump_x)) << 32 |
+                    (UINT32_MAX - cost));
+    }
+  }
+  if (finder->generations[finder->goal] != closed) {
+    return false;
+  }
+  for (uint32_t cell = finder->goal; cell != start;
+       cell = finder->parent[cell]) {
+    finder->path[finder->path_length++] = cell;
+  }
+  for (size_t i = 0; i < finder->path_length / 2; ++i) {
+    const uint32_t temp = finder->path[i];
+    finder->path[i] = finder->path[finder->path_length - 1 - i];
+    finder->path[finder->path_length - 1 - i] = temp;
+  }
+  return true;
+}
+
+// Gets the columns Robot can stand in to touch the item from: on its row,
+// with the spans of the two icons overlapping. Robot touches the leftmost
+// item its span covers, so the span must not cover another item left of this
+// one.
+void GetTouchSpan(const Game* game, size_t item_number, int* min_x,
+                  int* max_x) {
+  const Item* item = &game->items[item_number];
+  *min_x = item->x - GetItemWidth(&game->items[Robot]) + 1;
+  *max_x = item->x + GetItemWidth(item) - 1;
+  for (int x = item->x - 1; x >= *min_x; --x) {
+    const uint32_t occupant = GetOccupant(game, item->y, x);
+    if (occupant != 0 && occupant - 1 != Robot) {
+      *min_x = x + 1;
+      break;
+    }
+  }
+}
+
+// Returns true if some sequence of moves has Robot touch the item.
+bool CanReachItem(PathFinder* finder, const Game* game, size_t item_number) {
+  int min_x = 0;
+  int max_x = 0;
+  GetTouchSpan(game, item_number, &min_x, &max_x);
+  for (int x = min_x; x <= max_x; ++x) {
+    if (FindPath(finder, game, game->items[item_number].y, x)) {
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,25 @@
+// Finding paths for Robot across the field, by jump point search, for
+// click-to-move and the autopilot.
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+
+#ifndef PATH_H
+#define PATH_H
+
+#include <stdbool.h>
+
+#include "game.h"
+
+// What a straight and a diagonal step cost a path; see FindPath.
+enum { StraightCost = 5, DiagonalCost = 7 };
+
+int Sign(int n);
+Direction GetDirection(int dy, int dx);
+bool FindPath(PathFinder* finder, const Game* game, int y, int x);
+void GetTouchSpan(const Game* game, size_t item_number, int* min_x, int* max_x);
+bool CanReachItem(PathFinder* finder, const Game* game, size_t item_number);
+
+#endif  // PATH_H
@@ -17,535 +17,400 @@
 // this program; if not, write to the Free Software Foundation, Inc., 59 Temple
 // Place, Suite 330, Boston, MA  02111-1307  USA
 
+#define _DARWIN_C_SOURCE
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 700
 #define _XOPEN_SOURCE_EXTENDED
 
-#include <assert.h>
 #include <getopt.h>
 #include <locale.h>
-#include <ncurses.h>
 #include <signal.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <stdnoreturn.h>
-#include <string.h>
-#include <time.h>
-#include <unistd.h>
 
-#include "non_kitten_items.h"
+#include "autopilot.h"
+#include "game.h"
+#include "server.h"
+#include "stats.h"
+#include "tools.h"
+#include "ui.h"
 
-static const char Introduction[] =
-    "This is robotfindskitten, version 2.718281828, by the illustrious\n"
-    "Leonard Richardson © 1997, 2000.\n"
-    "\n"
-    "Written originally for the Nerth Pork robotfindskitten contest.\n"
-    "\n"
-    "In this game, you are Robot 🤖. Your job is to find Kitten 😺.\n"
-    "Inevitably, this task is complicated by the existence of various\n"
-    "items which are not Kitten. As in our world, things are rarely what\n"
-    "they seem, so you must touch them to determine whether they are\n"
-    "Kitten or not.\n"
-    "\n"
-    "The game ends when robotfindskitten. Alternatively, you may end\n"
-    "the game by pressing the Q key or a good old-fashioned Control-C.\n"
-    "\n"
-    "You can move using the arrow keys, the Emacs movement control sequences,\n"
-    "the vi and NetHack movement keys, or the number keypad.\n"
-    "\n"
-    "Press any key to start.\n";
-static const char WinMessage[] = "You found Kitten! Way to go, Robot!";
-
-#define CONTROL(key) ((key)&0x1f)
-
-#define COUNT(a) (sizeof((a)) / sizeof((a)[0]))
-
-typedef enum KeyCode {
-  NetHack_down = 'j',
-  NetHack_DOWN = 'J',
-  NetHack_up = 'k',
-  NetHack_UP = 'K',
-  NetHack_left = 'h',
-  NetHack_LEFT = 'H',
-  NetHack_right = 'l',
-  NetHack_RIGHT = 'L',
-  NetHack_up_left = 'y',
-  NetHack_UP_LEFT = 'Y',
-  NetHack_up_right = 'u',
-  NetHack_UP_RIGHT = 'U',
-  NetHack_down_left = 'b',
-  NetHack_DOWN_LEFT = 'B',
-  NetHack_down_right = 'n',
-  NetHack_DOWN_RIGHT = 'N',
-
-  NumLock_UP_LEFT = '7',
-  NumLock_UP = '8',
-  NumLock_UP_RIGHT = '9',
-  NumLock_LEFT = '4',
-  NumLock_RIGHT = '6',
-  NumLock_DOWN_LEFT = '1',
-  NumLock_DOWN = '2',
-  NumLock_DOWN_RIGHT = '3',
-
-  Emacs_NEXT = CONTROL('N'),
-  Emacs_PREVIOUS = CONTROL('P'),
-  Emacs_BACKWARD = CONTROL('B'),
-  Emacs_FORWARD = CONTROL('F'),
-
-  Key_RedrawScreen = CONTROL('L'),
-  Key_quit = 'q',
-  Key_QUIT = 'Q',
-} KeyCode;
-
-static const int HeaderSize = 1;
-static const int FrameThickness = 1;
-static const unsigned int White = 7;
-
-typedef struct Item {
-  int x;
-  int y;
-  char* icon;
-} Item;
-
-static Item g_items[COUNT(Messages)];
-static unsigned int g_border_color;
-static size_t g_non_kitten_count;
-
-// Special indices in the g_items array.
-static const size_t Robot = 0;
-static const size_t Kitten = 1;
-static const size_t Bogus = 2;
-
-static bool StringsEqual(const char* a, const char* b) {
-  return strcmp(a, b) == 0;
-}
-
-static void Shuffle(char** array, size_t count) {
-  assert(count > 2);
-  for (size_t i = 0; i < count - 2; ++i) {
-    const size_t j = i + ((size_t)random() % (count - i));
-    assert(i <= j && j < count);
-    char* temp = array[i];
-    array[i] = array[j];
-    array[j] = temp;
-  }
-}
-
-static int GetRandomX(void) {
-  return FrameThickness + (random() % (COLS - FrameThickness * 2));
-}
-
-static int GetRandomY(void) {
-  return HeaderSize + FrameThickness +
-         (random() % (LINES - HeaderSize - FrameThickness * 2));
-}
-
-static unsigned int GetRandomColor(void) {
-  return ((unsigned int)random()) % 6 + 1;
-}
-
-static char* GetRandomIcon(void) {
-  static size_t previous = 0;
-  char* r = Icons[previous];
-  previous = (previous + 1) % COUNT(Icons);
-  return r;
-}
-
-static bool ItemsCoincide(const Item* a, const Item* b) {
-  return a->x == b->x && a->y == b->y;
-}
+int main(int count, char* arguments[]) {
+  // Icon widths, and thus placement, depend on the locale's character set.
+  setlocale(LC_ALL, "");
+  MeasureIcons();
 
-typedef enum TouchTestResult {
-  TouchTestResultNone,
-  TouchTestResultRobot,
-  TouchTestResultKitten,
-  TouchTestResultNonKitten,
-} TouchTestResult;
+  Ui* ui = &g_ui;
+  uint64_t seed = (uint64_t)time(0);
+  bool seed_present = false;
+  size_t non_kitten_count = 20;
+  bool options_present = false;
+  int field_width = 0;
+  int field_height = 0;
+  const Strategy* strategy = NULL;
+  uint64_t benchmark_seeds = 0;
+  bool protocol = false;
+  bool hard = false;
+  int fog_radius = 0;
+  int spacing = 0;
+  const char* serve_path = NULL;
+  const char* connect_path = NULL;
+  const char* zygote_path = NULL;
+  const char* attach_path = NULL;
+  const char* publish_name = NULL;
+  const char* watch_name = NULL;
+  const char* restore_path = NULL;
+  const char* replay_path = NULL;
+  uint64_t search_seeds = 0;
+  const char* metric_list = "distance";
+  size_t top_count = 10;
+
+  enum {
+    OptionStats = 256,
+    OptionTrace,
+    OptionEventLog,
+    OptionInputThread,
+    OptionFramesPerSecond,
+    OptionSize,
+    OptionAutopilot,
+    OptionAutopilotDelay,
+    OptionBenchmark,
+    OptionBot,
+    OptionProtocol,
+    OptionTickRate,
+    OptionHard,
+    OptionFog,
+    OptionServe,
+    OptionConnect,
+    OptionZygote,
+    OptionAttach,
+    OptionPublish,
+    OptionWatch,
+    OptionSave,
+    OptionRestore,
+    OptionGrow,
+    OptionReplay,
+    OptionFindSeeds,
+    OptionMetric,
+    OptionTop,
+    OptionSpacing,
+    OptionSonar,
+  };
+  static const struct option long_options[] = {
+      {"attach", required_argument, NULL, OptionAttach},
+      {"autopilot", required_argument, NULL, OptionAutopilot},
+      {"autopilot-delay", required_argument, NULL, OptionAutopilotDelay},
+      {"benchmark", required_argument, NULL, OptionBenchmark},
+      {"bot", required_argument, NULL, OptionBot},
+      {"connect", required_argument, NULL, OptionConnect},
+      {"event-log", required_argument, NULL, OptionEventLog},
+      {"find-seeds", required_argument, NULL, OptionFindSeeds},
+      {"fog", required_argument, NULL, OptionFog},
+      {"fps", required_argument, NULL, OptionFramesPerSecond},
+      {"grow", required_argument, NULL, OptionGrow},
+      {"hard", no_argument, NULL, OptionHard},
+      {"metric", required_argument, NULL, OptionMetric},
+      {"input-thread", no_argument, NULL, OptionInputThread},
+      {"protocol", no_argument, NULL, OptionProtocol},
+      {"publish", required_argument, NULL, OptionPublish},
+      {"replay", required_argument, NULL, OptionReplay},
+      {"restore", required_argument, NULL, OptionRestore},
+      {"save", required_argument, NULL, OptionSave},
+      {"serve", required_argument, NULL, OptionServe},
+      {"size", required_argument, NULL, OptionSize},
+      {"sonar", required_argument, NULL, OptionSonar},
+      {"spacing", required_argument, NULL, OptionSpacing},
+      {"stats", required_argument, NULL, OptionStats},
+      {"tick-rate", required_argument, NULL, OptionTickRate},
+      {"top", required_argument, NULL, OptionTop},
+      {"trace", required_argument, NULL, OptionTrace},
+      {"watch", required_argument, NULL, OptionWatch},
+      {"zygote", required_argument, NULL, OptionZygote},
+      {NULL, 0, NULL, 0},
+  };
 
-static TouchTestResult TouchTest(int y, int x, size_t* item_number) {
-  for (size_t i = 0; i < g_non_kitten_count; ++i) {
-    if (g_items[i].x == x && g_items[i].y == y) {
-      *item_number = i;
-      if (Robot == i) {
-        return TouchTestResultRobot;
-      } else if (Kitten == i) {
-        return TouchTestResultKitten;
-      } else {
-        return TouchTestResultNonKitten;
-      }
+  while (true) {
+    const int option =
+        getopt_long(count, arguments, "n:s:h", long_options, NULL);
+    if (-1 == option) {
+      break;
     }
-  }
-  return TouchTestResultNone;
-}
-
-static noreturn void Finish(int signal) {
-  endwin();
-  exit(signal);
-}
-
-static void InitializeGame(size_t non_kitten_count) {
-  // Shuffle only the items after the Robot and Kitten placeholders:
-  Shuffle(&Messages[Bogus], COUNT(Messages) - Bogus);
-  // Ensure that we did that correctly:
-  assert(StringsEqual("", Messages[Robot]));
-  assert(StringsEqual("", Messages[Kitten]));
-
-  Shuffle(Icons, COUNT(Icons));
-  g_non_kitten_count = Bogus + non_kitten_count;
-  g_border_color = GetRandomColor();
-
-  // Set up (n)curses.
-  initscr();
-  nonl();
-  noecho();
-  cbreak();
-  intrflush(stdscr, false);
-  keypad(stdscr, true);
-  start_color();
-  if (has_colors() && (COLOR_PAIRS > 7)) {
-    init_pair(1, COLOR_GREEN, COLOR_BLACK);
-    init_pair(2, COLOR_RED, COLOR_BLACK);
-    init_pair(3, COLOR_YELLOW, COLOR_BLACK);
-    init_pair(4, COLOR_BLUE, COLOR_BLACK);
-    init_pair(5, COLOR_MAGENTA, COLOR_BLACK);
-    init_pair(6, COLOR_CYAN, COLOR_BLACK);
-    init_pair(7, COLOR_WHITE, COLOR_BLACK);
-    bkgd((chtype)COLOR_PAIR(White));
-  }
-
-  if (((LINES - HeaderSize - FrameThickness) * COLS) <
-      (int)(non_kitten_count + 2)) {
-    endwin();
-    fprintf(stderr, "Screen too small to fit all objects!\n");
-    exit(EXIT_FAILURE);
-  }
-
-  g_items[Robot].icon = "🤖";  // We are a curious robot.
-  g_items[Robot].y = GetRandomY();
-  g_items[Robot].x = GetRandomX();
-
-  g_items[Kitten].icon = GetRandomIcon();
-  do {
-    g_items[Kitten].y = GetRandomY();
-    g_items[Kitten].x = GetRandomX();
-  } while (ItemsCoincide(&g_items[Robot], &g_items[Kitten]));
 
-  for (size_t i = Bogus; i < g_non_kitten_count; ++i) {
-    g_items[i].icon = GetRandomIcon();
-    while (true) {
-      g_items[i].y = GetRandomY();
-      g_items[i].x = GetRandomX();
-      if (ItemsCoincide(&g_items[Robot], &g_items[i]) ||
-          ItemsCoincide(&g_items[Kitten], &g_items[i])) {
-        continue;
+    switch (option) {
+      case 'n': {
+        non_kitten_count = (size_t)abs(atoi(optarg));
+        options_present = true;
+        break;
       }
-      size_t j;
-      for (j = 0; j < i; ++j) {
-        if (ItemsCoincide(&g_items[j], &g_items[i])) {
-          break;
+      case 's':
+        seed = strtoull(optarg, NULL, 0);
+        seed_present = true;
+        options_present = true;
+        break;
+      case OptionStats:
+        g_stats_path = optarg;
+        break;
+      case OptionTrace:
+        StartTracing(optarg);
+        break;
+      case OptionEventLog:
+        StartEventLog(optarg);
+        break;
+      case OptionInputThread:
+        g_input.enabled = true;
+        break;
+      case OptionFramesPerSecond: {
+        const int fps = atoi(optarg);
+        g_input.frames_per_second = fps > 0 ? (unsigned int)fps : 1;
+        break;
+      }
+      case OptionSize:
+        if (sscanf(optarg, "%dx%d", &field_width, &field_height) != 2 ||
+            field_width <= 0 || field_height <= 0) {
+          fprintf(stderr, "Bad field size: %s\n", optarg);
+          exit(EXIT_FAILURE);
         }
+        g_fixed_size = true;
+        break;
+      case OptionAutopilot:
+        strategy = FindStrategy(optarg);
+        if (strategy == NULL) {
+          fprintf(stderr, "Unknown strategy: %s\n", optarg);
+          exit(EXIT_FAILURE);
+        }
+        break;
+      case OptionAutopilotDelay: {
+        const int delay = atoi(optarg);
+        ui->autopilot.timer.interval =
+            (uint64_t)(delay > 0 ? delay : 0) * 1000000;
+        break;
       }
-      if (j == i) {
+      case OptionBenchmark:
+        benchmark_seeds = strtoull(optarg, NULL, 0);
+        break;
+      case OptionBot:
+        strategy = LoadBot(optarg);
+        break;
+      case OptionProtocol:
+        protocol = true;
+        break;
+      case OptionTickRate: {
+        const int rate = atoi(optarg);
+        ui->tick.enabled = rate > 0;
+        ui->tick.interval = rate > 0 ? 1000000000 / (uint64_t)rate : 0;
         break;
       }
-    }
-  }
-}
-
-static void DrawItem(const Item* o) {
-  mvprintw(o->y, o->x, "%s", o->icon);
-}
-
-static void DrawMessage(const char* message) {
-  int y, x;
-  getyx(curscr, y, x);
-  if (has_colors()) {
-    attrset(COLOR_PAIR(White));
-  }
-  move(0, 0);
-  clrtoeol();
-  mvprintw(0, 0, "%.*s", COLS, message);
-  move(y, x);
-  refresh();
-}
-
-static void RedrawScreen(void) {
-  const unsigned int attributes = COLOR_PAIR(g_border_color) | A_BOLD;
-  const bool colors = has_colors();
-  if (colors) {
-    attron(attributes);
-  }
-  clear();
-  mvadd_wch(HeaderSize, 0, WACS_ULCORNER);
-  mvadd_wch(HeaderSize, COLS - 1, WACS_URCORNER);
-  mvadd_wch(LINES - 1, 0, WACS_LLCORNER);
-  mvadd_wch(LINES - 1, COLS - 1, WACS_LRCORNER);
-  for (int i = 1; i < COLS - 1; ++i) {
-    mvadd_wch(HeaderSize, i, WACS_HLINE);
-    mvadd_wch(LINES - 1, i, WACS_HLINE);
-  }
-  for (int i = FrameThickness + HeaderSize; i < LINES - 1; ++i) {
-    mvadd_wch(i, 0, WACS_VLINE);
-    mvadd_wch(i, COLS - 1, WACS_VLINE);
-  }
-
-  move(0, 0);
-  if (colors) {
-    attroff(attributes);
-  }
-  for (size_t i = 0; i < g_non_kitten_count; ++i) {
-    DrawItem(&g_items[i]);
-  }
-  move(g_items[Robot].y, g_items[Robot].x);
-  if (colors) {
-    attrset(COLOR_PAIR(White));
-  }
-  refresh();
-}
-
-static void HandleResize(void) {
-  int xbound = 0, ybound = 0;
-  for (size_t i = 0; i < g_non_kitten_count; ++i) {
-    if (g_items[i].x > xbound) {
-      xbound = g_items[i].x;
-    }
-    if (g_items[i].y > ybound) {
-      ybound = g_items[i].y;
-    }
-  }
-
-  // Has the resize hidden any items?
-  if (xbound >= COLS - FrameThickness * 2 ||
-      ybound >= HeaderSize + LINES - FrameThickness * 2) {
-    endwin();
-    fprintf(stderr, "You crushed the simulation. And robot. And kitten.\n");
-    exit(EXIT_FAILURE);
-  }
-
-  RedrawScreen();
-}
-
-static void ShowIntroduction(void) {
-  clear();
-  move(0, 0);
-  printw(Introduction);
-  refresh();
-  if (getch() == KEY_RESIZE) {
-    HandleResize();
-  }
-  clear();
-}
-
-static void PlayAnimation(bool approach_from_right) {
-  move(0, 0);
-  clrtoeol();
-  const int animation_meet = (COLS / 2);
-
-  Item kitten;
-  memcpy(&kitten, &g_items[Kitten], sizeof(kitten));
-
-  Item robot;
-  memcpy(&robot, &g_items[Robot], sizeof(robot));
-
-  g_items[Robot].y = g_items[Kitten].y = 0;
-  for (int i = 4; i > 0; --i) {
-    printf("\a");
-
-    g_items[Robot].icon = " ";
-    DrawItem(&g_items[Robot]);
-    g_items[Kitten].icon = " ";
-    DrawItem(&g_items[Kitten]);
-
-    g_items[Robot].icon = "🤖";
-    g_items[Kitten].icon = "😺";
-    if (approach_from_right) {
-      g_items[Robot].x = animation_meet + i;
-      g_items[Kitten].x = animation_meet - i + 1;
-    } else {
-      g_items[Robot].x = animation_meet - i + 1;
-      g_items[Kitten].x = animation_meet + i;
-    }
-
-    DrawItem(&kitten);
-    DrawItem(&robot);
-
-    DrawItem(&g_items[Robot]);
-    DrawItem(&g_items[Kitten]);
-    move(g_items[Robot].y, g_items[Robot].x);
-    refresh();
-    sleep(1);
-  }
-  DrawMessage(WinMessage);
-  curs_set(0);
-  sleep(1);
-}
-
-static void MainLoop(void) {
-  while (true) {
-    const int ch = getch();
-    if (ch == 0) {
-      break;
-    }
-
-    int y = g_items[Robot].y;
-    int x = g_items[Robot].x;
-    size_t item_number = 0;
-    bool approach_from_right = false;
-
-    switch (ch) {
-      case NetHack_UP_LEFT:
-      case NetHack_up_left:
-      case NumLock_UP_LEFT:
-      case KEY_A1:
-      case KEY_HOME:
-        --y;
-        --x;
-        approach_from_right = true;
+      case OptionHard:
+        hard = true;
         break;
-      case Emacs_PREVIOUS:
-      case NetHack_UP:
-      case NetHack_up:
-      case NumLock_UP:
-      case KEY_UP:
-        // approach_from_right: special case
-        --y;
-        approach_from_right = true;
+      case OptionServe:
+        serve_path = optarg;
         break;
-      case NetHack_UP_RIGHT:
-      case NetHack_up_right:
-      case NumLock_UP_RIGHT:
-      case KEY_A3:
-      case KEY_PPAGE:
-        --y;
-        ++x;
+      case OptionConnect:
+        connect_path = optarg;
         break;
-      case Emacs_BACKWARD:
-      case NetHack_LEFT:
-      case NetHack_left:
-      case NumLock_LEFT:
-      case KEY_LEFT:
-        --x;
-        approach_from_right = true;
+      case OptionZygote:
+        zygote_path = optarg;
         break;
-      case Emacs_FORWARD:
-      case NetHack_RIGHT:
-      case NetHack_right:
-      case NumLock_RIGHT:
-      case KEY_RIGHT:
-        ++x;
-        approach_from_right = false;
+      case OptionAttach:
+        attach_path = optarg;
         break;
-      case NetHack_DOWN_LEFT:
-      case NetHack_down_left:
-      case NumLock_DOWN_LEFT:
-      case KEY_C1:
-      case KEY_END:
-        ++y;
-        --x;
-        approach_from_right = true;
+      case OptionPublish:
+        publish_name = optarg;
         break;
-      case Emacs_NEXT:
-      case NetHack_DOWN:
-      case NetHack_down:
-      case NumLock_DOWN:
-      case KEY_DOWN:
-        ++y;
+      case OptionWatch:
+        watch_name = optarg;
         break;
-      case NetHack_DOWN_RIGHT:
-      case NetHack_down_right:
-      case NumLock_DOWN_RIGHT:
-      case KEY_C3:
-      case KEY_NPAGE:
-        ++y;
-        ++x;
+      case OptionSave:
+        g_save_path = optarg;
         break;
-      case Key_QUIT:
-      case Key_quit:
-        Finish(EXIT_FAILURE);
-      case Key_RedrawScreen:
-        RedrawScreen();
+      case OptionRestore:
+        restore_path = optarg;
+        options_present = true;
         break;
-      case KEY_RESIZE:
-        HandleResize();
+      case OptionGrow:
+        g_growth = (size_t)abs(atoi(optarg));
         break;
-      default:
-        DrawMessage("Use direction keys or Q to quit.");
+      case OptionReplay:
+        replay_path = optarg;
         break;
-    }
-
-    // It's the edge of the world as we know it...
-    if ((y < HeaderSize + FrameThickness) || (y >= LINES - FrameThickness) ||
-        (x < FrameThickness) || (x >= COLS - FrameThickness)) {
-      continue;
-    }
-
-    // Let's see where we've landed.
-    switch (TouchTest(y, x, &item_number)) {
-      case TouchTestResultNone:
-        // Robot moved.
-        g_items[Robot].y = y;
-        g_items[Robot].x = x;
-        move(y, x);
-        DrawItem(&g_items[Robot]);
-        // Using RedrawScreen instead of refresh restores the icon the
-        // robot touched, but is visibly slower.
-        RedrawScreen();
+      case OptionFindSeeds:
+        search_seeds = strtoull(optarg, NULL, 0);
         break;
-      case TouchTestResultRobot:
-        // Nothing happened.
+      case OptionMetric:
+        metric_list = optarg;
         break;
-      case TouchTestResultKitten:
-        PlayAnimation(approach_from_right);
-        Finish(EXIT_SUCCESS);
-      case TouchTestResultNonKitten:
-        DrawMessage(Messages[item_number]);
+      case OptionTop:
+        top_count = (size_t)abs(atoi(optarg));
         break;
-    }
-  }
-}
-
-int main(int count, char* arguments[]) {
-  signal(SIGINT, Finish);
-
-#if defined(__APPLE__) && defined(__MACH__)
-  setlocale(LC_ALL, "");
-#else
-  setlocale(LC_ALL, NULL);
-#endif
-
-  unsigned int seed = (unsigned int)time(0);
-  size_t non_kitten_count = 20;
-  bool options_present = false;
-
-  while (true) {
-    const int option = getopt(count, arguments, "n:s:h");
-    if (-1 == option) {
-      break;
-    }
-
-    switch (option) {
-      case 'n': {
-        non_kitten_count = (size_t)abs(atoi(optarg));
-        options_present = true;
+      case OptionSpacing:
+        spacing = atoi(optarg);
+        if (spacing <= 0) {
+          fprintf(stderr, "Bad spacing: %s\n", optarg);
+          exit(EXIT_FAILURE);
+        }
         break;
-      }
-      case 's':
-        seed = (unsigned int)atoi(optarg);
-        options_present = true;
+      case OptionSonar:
+        g_sonar_radius = atoi(optarg);
+        if (g_sonar_radius <= 0) {
+          fprintf(stderr, "Bad sonar radius: %s\n", optarg);
+          exit(EXIT_FAILURE);
+        }
+        break;
+      case OptionFog:
+        fog_radius = atoi(optarg);
+        if (fog_radius <= 0) {
+          fprintf(stderr, "Bad fog radius: %s\n", optarg);
+          exit(EXIT_FAILURE);
+        }
         break;
       case 'h':
       case '?':
       default:
-        printf("Usage: %s [-n non-kitten-count] [-s seed]\n", arguments[0]);
+        printf(
+            "Usage: %s [-n non-kitten-count] [-s seed] [--size WxH]\n"
+            "       [--stats stats-file] [--trace trace-file]\n"
+            "       [--event-log event-log-file] [--sonar radius]\n"
+            "       [--tick-rate ticks-per-second] [--hard] [--fog radius]\n"
+            "       [--grow items-per-round] [--spacing columns]\n"
+            "       [--input-thread [--fps frames-per-second]]\n"
+            "       [--autopilot nearest|sweep|random | --bot bot.so\n"
+            "        [--autopilot-delay milliseconds]]\n"
+            "       [--benchmark seed-count] [--protocol]\n"
+            "       [--replay event-log-file]\n"
+            "       [--find-seeds seed-count [--top count]\n"
+            "        [--metric [-]distance|enclosure|density[,...]]]\n"
+            "       [--serve socket-path | --connect socket-path]\n"
+            "       [--zygote socket-path | --attach socket-path]\n"
+            "       [--publish shm-name | --watch shm-name]\n"
+            "       [--save snapshot-file] [--restore snapshot-file]\n",
+            arguments[0]);
         exit(EXIT_SUCCESS);
     }
   }
 
-  srandom(seed);
-  InitializeGame(non_kitten_count);
+  // The items wander only with --tick-rate, but with --hard, Kitten needs
+  // ticks to move on.
+  const bool items_wander = ui->tick.enabled;
+  if (hard && !ui->tick.enabled) {
+    ui->tick.enabled = true;
+    ui->tick.interval = 1000000000 / HardTickRate;
+  }
+
+  if (connect_path != NULL) {
+    RunClient(connect_path);
+  }
+  if (attach_path != NULL) {
+    RunAttach(attach_path);
+  }
+  if (watch_name != NULL) {
+    RunWatch(ui, watch_name);
+  }
+  // Without a terminal, the field defaults to a classic 80 × 24 terminal,
+  // less the header.
+  if (!g_fixed_size && (benchmark_seeds > 0 || search_seeds > 0 || protocol)) {
+    field_width = 80;
+    field_height = 24 - HeaderSize;
+  }
+  if (replay_path != NULL) {
+    RunReplay(replay_path);
+  }
+  if (search_seeds > 0) {
+    RunSeedSearch(field_width, field_height, non_kitten_count, spacing,
+                  seed_present ? seed : 1, search_seeds, metric_list,
+                  top_count);
+    return EXIT_SUCCESS;
+  }
+  if (benchmark_seeds > 0) {
+    return RunBenchmark(strategy, field_width, field_height,
+                        non_kitten_count, spacing, seed_present ? seed : 1,
+                        benchmark_seeds)
+               ? EXIT_SUCCESS
+               : EXIT_FAILURE;
+  }
+  if (protocol) {
+    RunProtocol(field_width, field_height, non_kitten_count, seed);
+    return EXIT_SUCCESS;
+  }
+  if (serve_path != NULL) {
+    g_server.width = field_width;
+    g_server.height = field_height;
+    g_server.non_kitten_count = non_kitten_count;
+    g_server.items_wander = items_wander;
+    g_server.hard = hard;
+    g_server.fog_radius = fog_radius;
+    g_server.spacing = spacing;
+    g_server.seeds.state = seed;
+    RunServer(serve_path);
+  }
+
+  if (g_stats_path != NULL) {
+    atexit(WriteStats);
+    CatchSignal(SIGUSR1, HandleStatsSignal);
+  }
+
+  // A restored game keeps its own field, which scrolls if the screen is
+  // smaller.
+  if (restore_path != NULL) {
+    if (!RestoreGame(&ui->game, restore_path)) {
+      fprintf(stderr, "Bad snapshot: %s\n", restore_path);
+      exit(EXIT_FAILURE);
+    }
+    non_kitten_count = ui->game.item_count - Bogus;
+    g_fixed_size = true;
+  }
+  if (zygote_path != NULL) {
+    seed = RunZygote(ui, zygote_path, seed);
+    CatchFinishSignals();
+  } else {
+    CatchFinishSignals();
+    InitializeScreen(ui);
+  }
+  if (!g_fixed_size) {
+    field_width = COLS;
+    field_height = LINES - HeaderSize;
+  }
+  if (restore_path == NULL &&
+      !CreateGame(&ui->game, field_width, field_height, non_kitten_count)) {
+    endwin();
+    fprintf(stderr, "Screen too small to fit all objects!\n");
+    exit(EXIT_FAILURE);
+  }
+  // With --grow, make room for as many items as the field can hold.
+  if (g_growth > 0 &&
+      !ReserveItems(&ui->game,
+                    GetFieldCapacity(ui->game.width, ui->game.height))) {
+    endwin();
+    fprintf(stderr, "Could not allocate room for more items!\n");
+    exit(EXIT_FAILURE);
+  }
+  if (publish_name != NULL &&
+      !StartPublishing(publish_name, ui->game.item_capacity)) {
+    endwin();
+    perror(publish_name);
+    exit(EXIT_FAILURE);
+  }
+  ui->game.items_wander = items_wander;
+  ui->game.kitten_evades = hard;
+  ui->game.sight.radius = fog_radius;
+  ui->game.sampler.spacing = spacing;
+  if (restore_path != NULL) {
+    ResetDerivedState(&ui->game);
+  } else {
+    ResetGame(&ui->game, seed);
+  }
+  BuildLayers(ui);
+  LogStart(&ui->game);
+  if (strategy != NULL) {
+    ui->autopilot.timer.enabled = true;
+    ResetAutopilot(&ui->autopilot.autopilot, strategy, &ui->game);
+  }
   if (!options_present) {
-    ShowIntroduction();
+    ShowIntroduction(ui);
   }
-  RedrawScreen();
-  MainLoop();
+  RedrawScreen(ui);
+  MainLoop(ui);
   Finish(EXIT_SUCCESS);
 }
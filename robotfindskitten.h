@@ -0,0 +1,115 @@
+// The in-process bot API for robotfindskitten.
+//
+// A bot is a shared object that exports RfkGetBot. `robotfindskitten --bot
+// path/to/bot.so` loads it with dlopen, and then Robot plays by the bot's
+// decisions, through the same moves as the keyboard. With --benchmark, the
+// bot plays many games with no terminal at all, so each decision costs only
+// as much as the bot makes it cost.
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+
+#ifndef ROBOTFINDSKITTEN_H
+#define ROBOTFINDSKITTEN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Bumped whenever anything in this file changes incompatibly.
+#define RFK_API_VERSION 1
+
+// The name of the function a bot must export; see RfkGetBotFunction.
+#define RFK_BOT_ENTRY "RfkGetBot"
+
+// An opaque handle to one game.
+typedef struct RfkGame RfkGame;
+
+// The 8 directions Robot can move in, in clockwise order, so that turning is
+// adding to an RfkDirection (modulo RfkDirectionCount).
+typedef enum RfkDirection {
+  RfkDirectionUp,
+  RfkDirectionUpRight,
+  RfkDirectionRight,
+  RfkDirectionDownRight,
+  RfkDirectionDown,
+  RfkDirectionDownLeft,
+  RfkDirectionLeft,
+  RfkDirectionUpLeft,
+  RfkDirectionCount,
+} RfkDirection;
+
+// What happened when Robot tried to move.
+typedef enum RfkResult {
+  // Robot moved.
+  RfkResultMoved,
+  // Robot ran into the frame, and did not move.
+  RfkResultBlocked,
+  // Robot touched an item that is not Kitten, and did not move.
+  RfkResultTouched,
+  // Robot found Kitten. The game is over.
+  RfkResultKitten,
+} RfkResult;
+
+// Item numbers run from 0 to item_count - 1. Robot is always item 0. The
+// rest are in no particular order: which one is Kitten, you find out by
+// touching it.
+#define RFK_ROBOT 0
+#define RFK_NO_ITEM SIZE_MAX
+
+typedef struct RfkItem {
+  // The item covers `width` cells, from (y, x) to (y, x + width - 1). The
+  // frame is on row 0, row height - 1, column 0, and column width - 1.
+  int32_t x;
+  int32_t y;
+  int32_t width;
+  // Nonzero once Robot has touched the item.
+  int32_t touched;
+  // Once the item has been touched, the index of its message; otherwise -1.
+  int32_t message;
+} RfkItem;
+
+// The functions robotfindskitten provides to bots. A bot may create games of
+// its own, to try moves out, as well as observe the game it is playing.
+typedef struct RfkApi {
+  uint32_t version;
+
+  void (*get_size)(const RfkGame* game, int* width, int* height);
+  size_t (*get_item_count)(const RfkGame* game);
+  RfkItem (*get_item)(const RfkGame* game, size_t item);
+  // Returns the item covering the cell, or RFK_NO_ITEM.
+  size_t (*get_item_at)(const RfkGame* game, int y, int x);
+
+  // Tries to move Robot one cell. If Robot touches an item, `item` is set to
+  // it.
+  RfkResult (*step)(RfkGame* game, RfkDirection direction, size_t* item);
+  // Starts a new game on the same field. The same seed always produces the
+  // same game.
+  void (*reset)(RfkGame* game, uint64_t seed);
+
+  // Returns NULL if the items do not fit, or if memory runs out.
+  RfkGame* (*create_game)(int width, int height, size_t non_kitten_count);
+  void (*destroy_game)(RfkGame* game);
+} RfkApi;
+
+typedef struct RfkBot {
+  // Must be RFK_API_VERSION.
+  uint32_t api_version;
+  const char* name;
+
+  // Called at the start of each game the bot plays. Returns the bot's state
+  // for the game, which is passed to decide and finish.
+  void* (*start)(const RfkGame* game);
+  // Returns the direction Robot should try to move in next.
+  RfkDirection (*decide)(void* state, const RfkGame* game);
+  // Called when the game is over. May be NULL.
+  void (*finish)(void* state);
+} RfkBot;
+
+// Called once, when the bot is loaded. The bot should keep `api`, which stays
+// valid for as long as the bot is loaded, and return a description of itself,
+// or NULL if it cannot work with `api->version`.
+typedef const RfkBot* (*RfkGetBotFunction)(const RfkApi* api);
+
+#endif
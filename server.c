@@ -0,0 +1,1013 @@
+// This program is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+
+#define _DARWIN_C_SOURCE
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 700
+#define _XOPEN_SOURCE_EXTENDED
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdnoreturn.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/epoll.h>
+#endif
+
+#include "game.h"
+#include "server.h"
+#include "stats.h"
+#include "ui.h"
+
+// Returns true if `name` could be a TERM a client sent: it goes into a
+// terminfo path, so it may not hold slashes.
+static bool IsTerminalName(const char* name) {
+  return name[0] != '\0' &&
+         name[strspn(name,
+                     "abcdefghijklmnopqrstuvwxyz"
+                     "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789+-._")] == '\0';
+}
+
+// Returns a socket listening on the Unix domain socket at `path`, or exits.
+static int ListenOn(const char* path) {
+  struct sockaddr_un address = {.sun_family = AF_UNIX};
+  if (strlen(path) >= sizeof(address.sun_path)) {
+    fprintf(stderr, "Socket path too long: %s\n", path);
+    exit(EXIT_FAILURE);
+  }
+  strcpy(address.sun_path, path);
+  // A socket left behind by an earlier server would stop bind.
+  struct stat status;
+  if (stat(path, &status) == 0 && S_ISSOCK(status.st_mode)) {
+    unlink(path);
+  }
+  const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 ||
+      bind(fd, (const struct sockaddr*)&address, sizeof(address)) != 0 ||
+      listen(fd, SOMAXCONN) != 0) {
+    perror(path);
+    exit(EXIT_FAILURE);
+  }
+  return fd;
+}
+
+// Returns a socket connected to the Unix domain socket at `path`, or exits.
+static int ConnectTo(const char* path) {
+  struct sockaddr_un address = {.sun_family = AF_UNIX};
+  if (strlen(path) >= sizeof(address.sun_path)) {
+    fprintf(stderr, "Socket path too long: %s\n", path);
+    exit(EXIT_FAILURE);
+  }
+  strcpy(address.sun_path, path);
+  const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 || connect(fd, (const struct sockaddr*)&address,
+                        sizeof(address)) != 0) {
+    perror(path);
+    exit(EXIT_FAILURE);
+  }
+  return fd;
+}
+
+// With --serve, one process hosts many games at once, each played over its
+// own connection to a Unix domain socket by `robotfindskitten --connect`.
+// Each session has its own curses SCREEN, made by newterm on the connection,
+// and its own game. A single epoll loop waits for input on every connection
+// and for the sessions' next timer, and handles whatever is ready without
+// blocking. Each session has its own Ui for the UI functions to work on.
+// Curses never touches a connection: it writes to a file,
+// whose contents the server sends on, and the server reads the input itself
+// and decodes it as the input thread does.
+//
+// The client starts by sending a line with its TERM and screen size, and
+// then relays its terminal in raw mode. When its window changes size, it
+// sends "\033[8;rows;columnst", the sequence xterm reports its size with.
+
+// A client that falls this many bytes of output behind is dropped.
+enum { SessionOutputLimit = 1 << 20 };
+
+Server g_server;
+
+#if defined(__linux__)
+
+// Makes `screen` the current curses screen. set_term leaves LINES and COLS
+// as they were for the last screen made.
+static void SelectScreen(const SessionScreen* screen) {
+  set_term(screen->screen);
+  LINES = screen->rows;
+  COLS = screen->columns;
+}
+
+static void EnterSession(const Session* session) {
+  if (session->screen != NULL) {
+    SelectScreen(session->screen);
+  }
+}
+
+// Curses cannot ask a socket for its size, so it is told in LINES and
+// COLUMNS. It looks again when a screen comes back from endwin, and resizes
+// every screen's windows if the size has changed, so the size must be set
+// whenever a screen is attached, not just when one is made.
+static void SetScreenSize(int rows, int columns) {
+  char lines[16];
+  char cols[16];
+  snprintf(lines, sizeof(lines), "%d", rows);
+  snprintf(cols, sizeof(cols), "%d", columns);
+  setenv("LINES", lines, 1);
+  setenv("COLUMNS", cols, 1);
+}
+
+// Makes a new, idle screen of the size last given to SetScreenSize.
+static SessionScreen* CreateSessionScreen(const char* term, int rows,
+                                          int columns) {
+  SessionScreen* screen = calloc(1, sizeof(*screen));
+  if (screen == NULL) {
+    return NULL;
+  }
+  screen->output = tmpfile();
+  if (screen->output == NULL) {
+    free(screen);
+    return NULL;
+  }
+  screen->screen = newterm(term, screen->output, g_server.null);
+  if (screen->screen == NULL) {
+    fclose(screen->output);
+    free(screen);
+    return NULL;
+  }
+  snprintf(screen->term, sizeof(screen->term), "%s", term);
+  screen->rows = rows;
+  screen->columns = columns;
+  return screen;
+}
+
+// Gives the session a screen `rows` by `columns` on its connection,
+// an idle one if one fits. Returns false if curses cannot make one.
+static bool AttachScreen(Session* session, int rows, int columns) {
+  SetScreenSize(rows, columns);
+  SessionScreen** link = &g_server.idle_screens;
+  while (*link != NULL &&
+         (strcmp((*link)->term, session->term) != 0 ||
+          (*link)->rows != rows || (*link)->columns != columns)) {
+    link = &(*link)->next;
+  }
+  SessionScreen* screen = *link;
+  if (screen != NULL) {
+    *link = screen->next;
+  } else {
+    screen = CreateSessionScreen(session->term, rows, columns);
+    if (screen == NULL) {
+      return false;
+    }
+  }
+  session->screen = screen;
+  SelectScreen(screen);
+  // Curses would poll the input for typeahead, and /dev/null always has
+  // some.
+  typeahead(-1);
+  ConfigureScreen(&session->ui);
+  mousemask(BUTTON1_PRESSED | BUTTON1_CLICKED, NULL);
+  mouseinterval(0);
+  LoadKeySequences(&session->keys);
+  return true;
+}
+
+// Reads the first `length` bytes of `fd` onto the end of the session's
+// output. Returns false if it cannot, or if the client is too far behind.
+static bool AppendOutput(Session* session, int fd, size_t length) {
+  const size_t size = session->output_length + length;
+  if (size > SessionOutputLimit) {
+    return false;
+  }
+  if (size > session->output_capacity) {
+    const size_t capacity = size > 2 * session->output_capacity
+                                ? size
+                                : 2 * session->output_capacity;
+    char* grown = realloc(session->output, capacity);
+    if (grown == NULL) {
+      return false;
+    }
+    session->output = grown;
+    session->output_capacity = capacity;
+  }
+  if (pread(fd, &session->output[session->output_length], length, 0) !=
+      (ssize_t)length) {
+    return false;
+  }
+  session->output_length = size;
+  return true;
+}
+
+// Moves what curses has written to the session's screen onto the end
+// of its output, or drops it if not `keep`. Ends the game if it cannot.
+static void TakeScreenOutput(Session* session, bool keep) {
+  FILE* output = session->screen->output;
+  const long length = fflush(output) == 0 ? ftell(output) : -1;
+  const bool taken =
+      length >= 0 && (!keep || length == 0 ||
+                      AppendOutput(session, fileno(output), (size_t)length));
+  if (!taken || ftruncate(fileno(output), 0) != 0) {
+    session->ui.game_over = true;
+  }
+  rewind(output);
+}
+
+// Sends as much of the session's output as the connection will take, and
+// waits for it to take the rest. Returns false if the connection has failed.
+static bool FlushSession(Session* session) {
+  size_t sent = 0;
+  while (sent < session->output_length) {
+    const ssize_t n = write(session->fd, &session->output[sent],
+                            session->output_length - sent);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0 && errno == EAGAIN) {
+      break;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    sent += (size_t)n;
+  }
+  if (sent > 0) {
+    session->output_length -= sent;
+    memmove(session->output, &session->output[sent], session->output_length);
+  }
+  const bool waiting = session->output_length > 0;
+  if (waiting != session->waiting) {
+    struct epoll_event event = {
+        .events = (uint32_t)(waiting ? EPOLLIN | EPOLLOUT : EPOLLIN),
+        .data.ptr = session};
+    if (epoll_ctl(g_server.epoll, EPOLL_CTL_MOD, session->fd, &event) != 0) {
+      return false;
+    }
+    session->waiting = waiting;
+  }
+  return true;
+}
+
+// Puts the session's screen aside for another session. If `restore`,
+// curses first puts the client's terminal back the way it found it.
+static void DetachScreen(Session* session, bool restore) {
+  Ui* ui = &session->ui;
+  if (ui->frame_layer != NULL) {
+    delwin(ui->frame_layer);
+    delwin(ui->item_layer);
+    ui->frame_layer = ui->item_layer = NULL;
+  }
+  FreeMinimap(&ui->minimap);
+  // What curses has written so far is for the client, but what endwin
+  // writes is only if `restore`. Otherwise, endwin is so that whoever takes
+  // the screen over gets it set up afresh.
+  TakeScreenOutput(session, true);
+  endwin();
+  TakeScreenOutput(session, restore);
+  SessionScreen* screen = session->screen;
+  screen->next = g_server.idle_screens;
+  g_server.idle_screens = screen;
+  session->screen = NULL;
+}
+
+static void FreeIdleScreens(void) {
+  while (g_server.idle_screens != NULL) {
+    SessionScreen* screen = g_server.idle_screens;
+    g_server.idle_screens = screen->next;
+    delscreen(screen->screen);
+    fclose(screen->output);
+    free(screen);
+  }
+}
+
+static void EndSession(Session* session) {
+  EnterSession(session);
+  if (session->screen != NULL) {
+    DetachScreen(session, true);
+  }
+  DestroyGame(&session->ui.game);
+  // The client gets what it will take now, and no more.
+  FlushSession(session);
+  free(session->output);
+  epoll_ctl(g_server.epoll, EPOLL_CTL_DEL, session->fd, NULL);
+  close(session->fd);
+  if (session->previous != NULL) {
+    session->previous->next = session->next;
+  } else {
+    g_server.sessions = session->next;
+  }
+  if (session->next != NULL) {
+    session->next->previous = session->previous;
+  }
+  --g_server.session_count;
+  free(session);
+  if (g_server.session_count == 0) {
+    FreeIdleScreens();
+  }
+}
+
+static void AcceptSessions(void) {
+  while (true) {
+    const int fd = accept(g_server.listener, NULL, NULL);
+    if (fd < 0) {
+      return;
+    }
+    Session* session = calloc(1, sizeof(*session));
+    struct epoll_event event = {.events = EPOLLIN, .data.ptr = session};
+    if (session == NULL || fcntl(fd, F_SETFL, O_NONBLOCK) != 0 ||
+        fcntl(fd, F_SETFD, FD_CLOEXEC) != 0 ||
+        epoll_ctl(g_server.epoll, EPOLL_CTL_ADD, fd, &event) != 0) {
+      free(session);
+      close(fd);
+      continue;
+    }
+    session->fd = fd;
+    // A new session starts from the UI as main set it up.
+    session->ui = g_ui;
+    session->next = g_server.sessions;
+    if (session->next != NULL) {
+      session->next->previous = session;
+    }
+    g_server.sessions = session;
+    ++g_server.session_count;
+  }
+}
+
+// Handles the client's first line, "TERM rows columns", by starting the
+// game. Returns false if it cannot.
+static bool StartSession(Session* session, const char* line) {
+  int rows;
+  int columns;
+  if (sscanf(line, "%63s %d %d", session->term, &rows, &columns) != 3 ||
+      rows <= 0 || columns <= 0 || !IsTerminalName(session->term)) {
+    return false;
+  }
+  Ui* ui = &session->ui;
+  const int width = g_fixed_size ? g_server.width : columns;
+  const int height = g_fixed_size ? g_server.height : rows - HeaderSize;
+  if (!AttachScreen(session, rows, columns) ||
+      !CreateGame(&ui->game, width, height, g_server.non_kitten_count) ||
+      (g_growth > 0 &&
+       !ReserveItems(&ui->game, GetFieldCapacity(width, height)))) {
+    if (session->screen != NULL) {
+      DetachScreen(session, true);
+      FlushSession(session);
+      dprintf(session->fd, "Screen too small to fit all objects!\r\n");
+    }
+    return false;
+  }
+  ui->game.items_wander = g_server.items_wander;
+  ui->game.kitten_evades = g_server.hard;
+  ui->game.sight.radius = g_server.fog_radius;
+  ui->game.sampler.spacing = g_server.spacing;
+  ResetGame(&ui->game, NextRandom(&g_server.seeds));
+  BuildLayers(ui);
+  RedrawScreen(ui);
+  return true;
+}
+
+// Decodes the client's report of its new size, "\033[8;rows;columnst", at
+// the start of `buffer`, as KEY_RESIZE with the size in y and x. Returns
+// DecodeResultNone if that is not what is there.
+static DecodeResult DecodeResize(const char* buffer, size_t length, bool flush,
+                                 InputEvent* event, size_t* consumed) {
+  static const char Prefix[] = "\033[8;";
+  if (memcmp(buffer, Prefix, length < 4 ? length : 4) != 0) {
+    return DecodeResultNone;
+  }
+  const char* end = memchr(buffer, 't', length);
+  if (end == NULL) {
+    return flush ? DecodeResultNone : DecodeResultNeedMore;
+  }
+  if (sscanf(buffer, "\033[8;%d;%dt", &event->y, &event->x) != 2 ||
+      event->y <= 0 || event->x <= 0) {
+    return DecodeResultNone;
+  }
+  event->key = KEY_RESIZE;
+  *consumed = (size_t)(end - buffer) + 1;
+  return DecodeResultKey;
+}
+
+// Decodes and handles the keys in the session's buffer. `flush` is as for
+// DecodeKey.
+static void HandleSessionInput(Session* session, bool flush) {
+  Ui* ui = &session->ui;
+  session->flush_time = 0;
+  while (session->length > 0 && !ui->game_over) {
+    const char* buffer = session->buffer;
+    InputEvent event = {0};
+    size_t consumed;
+    DecodeResult result =
+        DecodeResize(buffer, session->length, flush, &event, &consumed);
+    if (result == DecodeResultNone) {
+      result = DecodeKey(&session->keys, buffer, session->length, flush,
+                         &event, &consumed);
+    }
+    if (result == DecodeResultNeedMore) {
+      session->flush_time =
+          Now() + (uint64_t)EscapeTimeoutMilliseconds * 1000000;
+      break;
+    }
+    if (result == DecodeResultKey) {
+      if (event.key == KEY_RESIZE) {
+        DetachScreen(session, false);
+        if (!AttachScreen(session, event.y, event.x)) {
+          ui->game_over = true;
+          break;
+        }
+      }
+      if (event.key == KEY_MOUSE) {
+        HandleClick(ui, event.y, event.x);
+      } else if (!HandleKey(ui, event.key, Now())) {
+        ui->game_over = true;
+      }
+    }
+    session->length -= consumed;
+    memmove(session->buffer, &buffer[consumed], session->length);
+  }
+}
+
+// Reads what the client has sent. Returns false if the session is over.
+static bool ReadSession(Session* session) {
+  const ssize_t n = read(session->fd, &session->buffer[session->length],
+                         sizeof(session->buffer) - session->length);
+  if (n <= 0) {
+    return n < 0 && (errno == EAGAIN || errno == EINTR);
+  }
+  session->length += (size_t)n;
+  if (!session->started) {
+    char* end = memchr(session->buffer, '\n', session->length);
+    if (end == NULL) {
+      return session->length < sizeof(session->buffer);
+    }
+    *end = '\0';
+    if (!StartSession(session, session->buffer)) {
+      return false;
+    }
+    session->started = true;
+    session->length -= (size_t)(end + 1 - session->buffer);
+    memmove(session->buffer, end + 1, session->length);
+  }
+  EnterSession(session);
+  HandleSessionInput(session, session->length == sizeof(session->buffer));
+  Render(&session->ui);
+  TakeScreenOutput(session, true);
+  return !session->ui.game_over && FlushSession(session);
+}
+
+// Returns the number of milliseconds until the session has something to do
+// without input, or `timeout` if that is sooner.
+static int GetSessionTimeout(const Session* session, int timeout) {
+  if (!session->started) {
+    return timeout;
+  }
+  if (session->flush_time != 0) {
+    const Timer flush = {.enabled = true, .next = session->flush_time};
+    timeout = GetTimerTimeout(&flush, timeout);
+  }
+  const Ui* ui = &session->ui;
+  return GetTimerTimeout(
+      &ui->walk.timer,
+      GetTimerTimeout(&ui->autopilot.timer,
+                      GetTimerTimeout(&ui->tick, timeout)));
+}
+
+// Runs the session's due timers, and flushes a stale escape. Returns false if
+// the session is over.
+static bool RunSessionTimers(Session* session) {
+  EnterSession(session);
+  if (session->flush_time != 0 && Now() >= session->flush_time) {
+    HandleSessionInput(session, true);
+  }
+  RunTimers(&session->ui);
+  Render(&session->ui);
+  TakeScreenOutput(session, true);
+  return !session->ui.game_over && FlushSession(session);
+}
+
+// Serves games on the socket at `path` until killed. g_server's settings must
+// be filled in.
+noreturn void RunServer(const char* path) {
+  g_server.listener = ListenOn(path);
+  g_server.epoll = epoll_create1(EPOLL_CLOEXEC);
+  g_server.null = fopen("/dev/null", "r+");
+  struct epoll_event listen_event = {.events = EPOLLIN, .data.ptr = NULL};
+  if (g_server.epoll < 0 || g_server.null == NULL ||
+      fcntl(g_server.listener, F_SETFL, O_NONBLOCK) != 0 ||
+      epoll_ctl(g_server.epoll, EPOLL_CTL_ADD, g_server.listener,
+                &listen_event) != 0) {
+    perror(path);
+    exit(EXIT_FAILURE);
+  }
+  g_serving = true;
+  // A client that hangs up mid-frame must not take the server with it.
+  signal(SIGPIPE, SIG_IGN);
+  CatchFinishSignals();
+
+  while (true) {
+    int timeout = -1;
+    for (const Session* s = g_server.sessions; s != NULL; s = s->next) {
+      timeout = GetSessionTimeout(s, timeout);
+    }
+    struct epoll_event events[64];
+    const int count =
+        epoll_wait(g_server.epoll, events, (int)COUNT(events), timeout);
+    HandleSignals();
+    for (int i = 0; i < count; ++i) {
+      Session* session = events[i].data.ptr;
+      const uint32_t flags = events[i].events;
+      if (session == NULL) {
+        AcceptSessions();
+      } else if (((flags & EPOLLOUT) != 0 && !FlushSession(session)) ||
+                 ((flags & ~(uint32_t)EPOLLOUT) != 0 &&
+                  !ReadSession(session))) {
+        EndSession(session);
+      }
+    }
+    Session* next;
+    for (Session* s = g_server.sessions; s != NULL; s = next) {
+      next = s->next;
+      if (GetSessionTimeout(s, -1) == 0 && !RunSessionTimers(s)) {
+        EndSession(s);
+      }
+    }
+  }
+}
+
+#else
+
+noreturn void RunServer(const char* path) {
+  fprintf(stderr, "Cannot serve on %s: --serve needs epoll.\n", path);
+  exit(EXIT_FAILURE);
+}
+
+#endif
+
+// With --connect, plays a game on a server started with --serve, by relaying
+// the terminal to it.
+noreturn void RunClient(const char* path) {
+  const int fd = ConnectTo(path);
+  struct winsize size = {.ws_row = 24, .ws_col = 80};
+  ioctl(STDOUT_FILENO, TIOCGWINSZ, &size);
+  const char* term = getenv("TERM");
+  dprintf(fd, "%s %d %d\n", term != NULL ? term : "vt100", size.ws_row,
+          size.ws_col);
+
+  struct termios saved;
+  const bool is_terminal = tcgetattr(STDIN_FILENO, &saved) == 0;
+  if (is_terminal) {
+    struct termios raw = saved;
+    cfmakeraw(&raw);
+    tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw);
+  }
+  if (pipe(g_input.resize) == 0) {
+    CatchSignal(SIGWINCH, HandleWindowChange);
+  }
+  char buffer[4096];
+  while (true) {
+    struct pollfd fds[] = {
+        {.fd = STDIN_FILENO, .events = POLLIN},
+        {.fd = fd, .events = POLLIN},
+        {.fd = g_input.resize[0], .events = POLLIN},
+    };
+    if (poll(fds, COUNT(fds), -1) < 0) {
+      continue;
+    }
+    if (fds[0].revents & (POLLIN | POLLHUP)) {
+      const ssize_t n = read(STDIN_FILENO, buffer, sizeof(buffer));
+      if (n <= 0 || write(fd, buffer, (size_t)n) != n) {
+        break;
+      }
+    }
+    if (fds[1].revents & (POLLIN | POLLHUP)) {
+      const ssize_t n = read(fd, buffer, sizeof(buffer));
+      if (n <= 0) {
+        break;
+      }
+      write(STDOUT_FILENO, buffer, (size_t)n);
+    }
+    if (fds[2].revents & POLLIN) {
+      read(g_input.resize[0], buffer, sizeof(buffer));
+      if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0) {
+        dprintf(fd, "\033[8;%d;%dt", size.ws_row, size.ws_col);
+      }
+    }
+  }
+  if (is_terminal) {
+    tcsetattr(STDIN_FILENO, TCSAFLUSH, &saved);
+  }
+  exit(EXIT_SUCCESS);
+}
+
+// With --zygote, a resident process does, once, the setup that every game
+// needs before anyone asks for one: the locale, the icon widths and, above
+// all, a curses screen loaded from the terminal's description, with its
+// colors set up. Then, for each client of --attach, it forks a child that
+// takes the client's terminal over and plays on it just as a game started
+// from the shell would, having only to seed the game and place the items.
+//
+// The client sends its TERM, with its standard input, output and error
+// attached as SCM_RIGHTS. The zygote answers with a line holding the child's
+// process ID and, when the child is done, a line holding its exit status.
+
+// A child playing a game, and the connection to the client it plays for.
+typedef struct ZygoteChild {
+  pid_t pid;
+  int fd;
+} ZygoteChild;
+
+static struct {
+  // The zygote's screen, set up on /dev/null, and the TERM it was set up for.
+  SCREEN* screen;
+  const char* term;
+  // A pipe HandleChildExit writes to, so that the zygote wakes up to reap.
+  int exits[2];
+  ZygoteChild* children;
+  size_t child_count;
+  size_t child_capacity;
+} g_zygote;
+
+static void HandleChildExit(int signal) {
+  (void)signal;
+  const int saved = errno;
+  write(g_zygote.exits[1], "", 1);
+  errno = saved;
+}
+
+// Tells the clients of the children that have exited their exit status.
+static void ReapChildren(void) {
+  int status;
+  pid_t pid;
+  while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+    for (size_t i = 0; i < g_zygote.child_count; ++i) {
+      ZygoteChild* child = &g_zygote.children[i];
+      if (child->pid == pid) {
+        dprintf(child->fd, "%d\n",
+                WIFEXITED(status) ? WEXITSTATUS(status)
+                                  : 128 + WTERMSIG(status));
+        close(child->fd);
+        *child = g_zygote.children[--g_zygote.child_count];
+        break;
+      }
+    }
+  }
+}
+
+// Receives the client's TERM, into `term`, and its terminal, into `terminal`.
+// Returns false if the client sent anything else.
+static bool ReceiveTerminal(int fd, char* term, size_t term_size,
+                            int terminal[3]) {
+  union {
+    struct cmsghdr header;
+    char buffer[CMSG_SPACE(3 * sizeof(int))];
+  } control;
+  struct iovec data = {.iov_base = term, .iov_len = term_size - 1};
+  struct msghdr message = {
+      .msg_iov = &data,
+      .msg_iovlen = 1,
+      .msg_control = control.buffer,
+      .msg_controllen = sizeof(control.buffer),
+  };
+  const ssize_t n = recvmsg(fd, &message, 0);
+  const struct cmsghdr* header = n < 0 ? NULL : CMSG_FIRSTHDR(&message);
+  if (header == NULL || header->cmsg_level != SOL_SOCKET ||
+      header->cmsg_type != SCM_RIGHTS) {
+    return false;
+  }
+  const size_t count = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+  int fds[3];
+  memcpy(fds, CMSG_DATA(header), (count < 3 ? count : 3) * sizeof(int));
+  term[n] = '\0';
+  if (count != 3 || !IsTerminalName(term)) {
+    for (size_t i = 0; i < count && i < 3; ++i) {
+      close(fds[i]);
+    }
+    return false;
+  }
+  memcpy(terminal, fds, sizeof(fds));
+  return true;
+}
+
+// In a newly forked child, moves the game onto the client's terminal.
+static void AttachTerminal(Ui* ui, const char* term, const int terminal[3]) {
+  for (int i = 0; i < 3; ++i) {
+    dup2(terminal[i], i);
+    close(terminal[i]);
+  }
+  setenv("TERM", term, 1);
+  if (strcmp(term, g_zygote.term) != 0) {
+    // The zygote's screen is no use; set up one of the client's own.
+    delscreen(g_zygote.screen);
+    SCREEN* screen = newterm(term, stdout, stdin);
+    if (screen == NULL) {
+      fprintf(stderr, "Unknown terminal type: %s\n", term);
+      exit(EXIT_FAILURE);
+    }
+    set_term(screen);
+    ConfigureScreen(ui);
+    return;
+  }
+  // The screen was set up on /dev/null, which has no modes: learn the
+  // terminal's, and set them as ConfigureScreen would have. The zygote left
+  // the screen as if endwin had suspended it, so the first refresh sets the
+  // terminal up as initscr would have.
+  def_shell_mode();
+  def_prog_mode();
+  nonl();
+  noecho();
+  cbreak();
+  UpdateTerminalSize();
+}
+
+// Runs the zygote on the socket at `path`. Returns only in a child, which is
+// to play a game on the client's terminal with the returned seed; `seed`
+// seeds the sequence of games.
+uint64_t RunZygote(Ui* ui, const char* path, uint64_t seed) {
+  const int listener = ListenOn(path);
+  const int null = open("/dev/null", O_RDWR);
+  if (null < 0 || pipe(g_zygote.exits) != 0) {
+    perror("zygote");
+    exit(EXIT_FAILURE);
+  }
+  // Curses writes to standard output, and reads standard input to learn
+  // the terminal's modes: the zygote has no terminal until a client comes.
+  dup2(null, STDIN_FILENO);
+  dup2(null, STDOUT_FILENO);
+  close(null);
+  g_zygote.term = getenv("TERM");
+  if (g_zygote.term == NULL) {
+    g_zygote.term = "vt100";
+  }
+  g_zygote.screen = newterm(g_zygote.term, stdout, stdin);
+  if (g_zygote.screen == NULL) {
+    fprintf(stderr, "Unknown terminal type: %s\n", g_zygote.term);
+    exit(EXIT_FAILURE);
+  }
+  set_term(g_zygote.screen);
+  ConfigureScreen(ui);
+  endwin();
+  signal(SIGCHLD, HandleChildExit);
+
+  Random seeds = {.state = seed};
+  while (true) {
+    struct pollfd fds[] = {
+        {.fd = listener, .events = POLLIN},
+        {.fd = g_zygote.exits[0], .events = POLLIN},
+    };
+    if (poll(fds, COUNT(fds), -1) < 0) {
+      continue;
+    }
+    if (fds[1].revents & POLLIN) {
+      char drain[64];
+      read(g_zygote.exits[0], drain, sizeof(drain));
+      ReapChildren();
+    }
+    if (!(fds[0].revents & POLLIN)) {
+      continue;
+    }
+    const int fd = accept(listener, NULL, NULL);
+    if (fd < 0) {
+      continue;
+    }
+    // A client that connects but sends nothing must not hold up the rest.
+    const struct timeval timeout = {.tv_sec = 1};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    char term[64];
+    int terminal[3];
+    if (!ReceiveTerminal(fd, term, sizeof(term), terminal)) {
+      close(fd);
+      continue;
+    }
+    if (g_zygote.child_count == g_zygote.child_capacity) {
+      const size_t capacity = 2 * g_zygote.child_capacity + 16;
+      ZygoteChild* bigger =
+          realloc(g_zygote.children, capacity * sizeof(*bigger));
+      if (bigger == NULL) {
+        for (int i = 0; i < 3; ++i) {
+          close(terminal[i]);
+        }
+        close(fd);
+        continue;
+      }
+      g_zygote.children = bigger;
+      g_zygote.child_capacity = capacity;
+    }
+    const uint64_t game_seed = NextRandom(&seeds);
+    const pid_t pid = fork();
+    if (pid == 0) {
+      signal(SIGCHLD, SIG_DFL);
+      close(listener);
+      close(g_zygote.exits[0]);
+      close(g_zygote.exits[1]);
+      for (size_t i = 0; i < g_zygote.child_count; ++i) {
+        close(g_zygote.children[i].fd);
+      }
+      close(fd);
+      AttachTerminal(ui, term, terminal);
+      return game_seed;
+    }
+    for (int i = 0; i < 3; ++i) {
+      close(terminal[i]);
+    }
+    if (pid < 0) {
+      close(fd);
+      continue;
+    }
+    dprintf(fd, "%d\n", (int)pid);
+    g_zygote.children[g_zygote.child_count++] =
+        (ZygoteChild){.pid = pid, .fd = fd};
+  }
+}
+
+// The game an --attach client stands in for.
+static pid_t g_attached_game;
+
+static void ForwardSignal(int signal) {
+  kill(g_attached_game, signal);
+}
+
+// With --attach, plays a game forked by a server started with --zygote. The
+// game runs in the server's child, on this terminal, which is passed to it
+// over the socket; this process only stands in for it, passing it the
+// signals the terminal sends, and exits with its status.
+noreturn void RunAttach(const char* path) {
+  const int fd = ConnectTo(path);
+  char term[64];
+  const char* name = getenv("TERM");
+  snprintf(term, sizeof(term), "%s", name != NULL ? name : "vt100");
+  const int terminal[3] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+  union {
+    struct cmsghdr header;
+    char buffer[CMSG_SPACE(sizeof(terminal))];
+  } control = {0};
+  struct iovec data = {.iov_base = term, .iov_len = strlen(term)};
+  struct msghdr message = {
+      .msg_iov = &data,
+      .msg_iovlen = 1,
+      .msg_control = control.buffer,
+      .msg_controllen = sizeof(control.buffer),
+  };
+  struct cmsghdr* header = CMSG_FIRSTHDR(&message);
+  header->cmsg_level = SOL_SOCKET;
+  header->cmsg_type = SCM_RIGHTS;
+  header->cmsg_len = CMSG_LEN(sizeof(terminal));
+  memcpy(CMSG_DATA(header), terminal, sizeof(terminal));
+  if (sendmsg(fd, &message, 0) < 0) {
+    perror(path);
+    exit(EXIT_FAILURE);
+  }
+
+  FILE* replies = fdopen(fd, "r");
+  int pid;
+  if (replies == NULL || fscanf(replies, "%d", &pid) != 1) {
+    fprintf(stderr, "The server did not start a game.\n");
+    exit(EXIT_FAILURE);
+  }
+  // The terminal sends its signals to this process, not to the game.
+  g_attached_game = pid;
+  signal(SIGINT, ForwardSignal);
+  signal(SIGTERM, ForwardSignal);
+  signal(SIGHUP, ForwardSignal);
+  signal(SIGWINCH, ForwardSignal);
+  // The game cannot be stopped from here, so neither can this.
+  signal(SIGTSTP, SIG_IGN);
+  int status;
+  if (fscanf(replies, "%d", &status) != 1) {
+    status = EXIT_FAILURE;
+  }
+  exit(status);
+}
+
+// How often --watch looks for a new frame.
+static const int WatchIntervalMilliseconds = 20;
+
+// Copies the frame a --publish game last painted into `game` and `message`,
+// if it is not the frame numbered `*shown`, which is then updated. Returns
+// false if there is no new frame.
+static bool ReadBroadcast(Game* game, const Broadcast* broadcast,
+                          uint64_t* shown, char* message) {
+  int width;
+  int height;
+  size_t count;
+  while (true) {
+    const uint64_t before =
+        atomic_load_explicit(&broadcast->sequence, memory_order_acquire);
+    if (before == *shown) {
+      return false;
+    }
+    if (before & 1) {
+      // The player is in the middle of a frame.
+      continue;
+    }
+    width = broadcast->width;
+    height = broadcast->height;
+    game->border_color = broadcast->border_color;
+    game->sight.radius = broadcast->fog_radius;
+    count = broadcast->item_count;
+    if (count > game->item_capacity) {
+      // A torn read; the sequence number will not match.
+      count = game->item_capacity;
+    }
+    memcpy(message, broadcast->message, sizeof(broadcast->message));
+    memcpy(game->items, broadcast->items, count * sizeof(Item));
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&broadcast->sequence, memory_order_relaxed) ==
+        before) {
+      *shown = before;
+      break;
+    }
+  }
+  message[sizeof(broadcast->message) - 1] = '\0';
+  if (count < Bogus) {
+    return false;
+  }
+  game->item_count = count;
+  for (size_t i = 0; i < game->item_count; ++i) {
+    const Item* item = &game->items[i];
+    if (!ItemIsValid(item) || item->x < FrameThickness ||
+        item->y < FrameThickness) {
+      return false;
+    }
+  }
+  // This also puts the items in the occupancy grid, which drawing uses.
+  return ResizeField(game, width, height);
+}
+
+// With --watch, follows a game started with --publish `name`, showing what
+// the player sees. The field keeps the player's size, and scrolls to follow
+// Robot if the spectator's screen is smaller.
+noreturn void RunWatch(Ui* ui, const char* name) {
+  const int fd = shm_open(name, O_RDONLY, 0);
+  struct stat status;
+  const Broadcast* broadcast = MAP_FAILED;
+  if (fd >= 0 && fstat(fd, &status) == 0 &&
+      (size_t)status.st_size >= sizeof(Broadcast)) {
+    broadcast = mmap(NULL, (size_t)status.st_size, PROT_READ, MAP_SHARED, fd,
+                     0);
+  }
+  if (broadcast == MAP_FAILED || broadcast->magic != BroadcastMagic ||
+      broadcast->version != BroadcastVersion ||
+      broadcast->item_capacity < Bogus ||
+      broadcast->item_capacity >
+          ((size_t)status.st_size - sizeof(Broadcast)) / sizeof(Item)) {
+    fprintf(stderr, "No game is published as %s\n", name);
+    exit(EXIT_FAILURE);
+  }
+  // Wait for the first frame, which tells how big to make the field. Each
+  // frame says how many items are in play.
+  while (atomic_load_explicit(&broadcast->sequence, memory_order_acquire) <
+         2) {
+    usleep(1000 * WatchIntervalMilliseconds);
+  }
+  if (!CreateGame(&ui->game, broadcast->width, broadcast->height, 0) ||
+      !ReserveItems(&ui->game, broadcast->item_capacity)) {
+    fprintf(stderr, "The game published as %s is damaged.\n", name);
+    exit(EXIT_FAILURE);
+  }
+  g_fixed_size = true;
+  CatchFinishSignals();
+  InitializeScreen(ui);
+  curs_set(0);
+  uint64_t shown = 0;
+  static char message[sizeof(broadcast->message)];
+  while (true) {
+    if (ReadBroadcast(&ui->game, broadcast, &shown, message)) {
+      ui->message = message;
+      if (ui->frame_layer == NULL) {
+        BuildLayers(ui);
+      } else {
+        FollowRobot(ui);
+        DrawLayers(ui);
+      }
+      ui->dirty.frame = true;
+    }
+    Render(ui);
+    timeout(WatchIntervalMilliseconds);
+    const int ch = getch();
+    HandleSignals();
+    if (ch == Key_quit || ch == Key_QUIT) {
+      break;
+    }
+    if (ch == KEY_RESIZE && ui->frame_layer != NULL) {
+      HandleResize(ui);
+    } else if (ch == Key_RedrawScreen) {
+      ui->dirty.full = true;
+    }
+  }
+  Finish(EXIT_SUCCESS);
+}
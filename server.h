@@ -0,0 +1,90 @@
+// Hosting games for other processes: --serve and --connect, --zygote and
+// --attach, and --watch.
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdnoreturn.h>
+
+#include "game.h"
+#include "ui.h"
+
+// A curses screen, and the file it writes to. Ncurses keeps one list of
+// windows for all its screens, so delscreen frees the windows of every
+// screen, and resize_term resizes them all. Screens therefore outlive their
+// sessions: when a session ends, or its client's window changes size, its
+// screen goes idle until a session with the same TERM and size takes it over.
+// Idle screens are freed once no sessions are left.
+//
+// Ncurses retries a write that would block until it goes through, so it
+// never writes to a connection: the server moves what it writes to the file
+// onto the session's output, and sends that as the connection takes it.
+typedef struct SessionScreen {
+  SCREEN* screen;
+  FILE* output;
+  char term[64];
+  int rows;
+  int columns;
+  struct SessionScreen* next;
+} SessionScreen;
+
+typedef struct Session {
+  int fd;
+  char term[64];
+  SessionScreen* screen;
+  // False until the client's first line has come in.
+  bool started;
+  char buffer[256];
+  size_t length;
+  // When to give up waiting for the rest of an escape sequence, or 0.
+  uint64_t flush_time;
+  // What the client has yet to take, and whether the server is waiting for
+  // the connection to take more.
+  char* output;
+  size_t output_length;
+  size_t output_capacity;
+  bool waiting;
+  struct Session* previous;
+  struct Session* next;
+
+  KeySequences keys;
+  Ui ui;
+} Session;
+
+typedef struct Server {
+  int epoll;
+  int listener;
+  // /dev/null. Every screen reads from this, since curses never reads a
+  // connection itself.
+  FILE* null;
+  // What every game is like, from the command line.
+  int width;
+  int height;
+  size_t non_kitten_count;
+  bool items_wander;
+  bool hard;
+  int fog_radius;
+  int spacing;
+  Random seeds;
+  Session* sessions;
+  size_t session_count;
+  SessionScreen* idle_screens;
+} Server;
+
+extern Server g_server;
+
+noreturn void RunServer(const char* path);
+noreturn void RunClient(const char* path);
+uint64_t RunZygote(Ui* ui, const char* path, uint64_t seed);
+noreturn void RunAttach(const char* path);
+noreturn void RunWatch(Ui* ui, const char* name);
+
+#endif  // SERVER_H
@@ -0,0 +1,451 @@
+// This program is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+
+#define _DARWIN_C_SOURCE
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 700
+#define _XOPEN_SOURCE_EXTENDED
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "stats.h"
+
+// Returns the current time on the monotonic clock, in nanoseconds.
+uint64_t Now(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+// Returns the CPU time the calling thread has used, in nanoseconds.
+uint64_t GetThreadTime(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+// Returns the least time measured between two readings of GetThreadTime,
+// which is what reading it adds to every interval timed with it.
+uint64_t GetThreadTimeOverhead(void) {
+  uint64_t least = UINT64_MAX;
+  for (int i = 0; i < 1000; ++i) {
+    const uint64_t start = GetThreadTime();
+    const uint64_t elapsed = GetThreadTime() - start;
+    least = elapsed < least ? elapsed : least;
+  }
+  return least;
+}
+
+static size_t HistogramIndex(uint64_t value) {
+  if (value < 2 * HistogramSubBuckets) {
+    return (size_t)value;
+  }
+  const int shift = 63 - __builtin_clzll(value) - HistogramSubBucketBits;
+  return (size_t)shift * HistogramSubBuckets + (size_t)(value >> shift);
+}
+
+// Returns the smallest value that falls into the bucket at `index`.
+static uint64_t HistogramValue(size_t index) {
+  if (index < 2 * HistogramSubBuckets) {
+    return index;
+  }
+  const size_t shift = index / HistogramSubBuckets - 1;
+  return (uint64_t)(index - shift * HistogramSubBuckets) << shift;
+}
+
+void HistogramRecord(Histogram* h, uint64_t value) {
+  atomic_fetch_add_explicit(&h->counts[HistogramIndex(value)], 1,
+                            memory_order_relaxed);
+  atomic_fetch_add_explicit(&h->count, 1, memory_order_relaxed);
+  uint64_t max = atomic_load_explicit(&h->max, memory_order_relaxed);
+  while (value > max && !atomic_compare_exchange_weak_explicit(
+                            &h->max, &max, value, memory_order_relaxed,
+                            memory_order_relaxed)) {
+  }
+}
+
+// Returns the value below which `fraction` of the recorded values fall.
+uint64_t HistogramPercentile(const Histogram* h, double fraction) {
+  const uint64_t count = atomic_load_explicit(&h->count, memory_order_relaxed);
+  if (count == 0) {
+    return 0;
+  }
+  uint64_t rank = (uint64_t)(fraction * (double)count + 0.5);
+  if (rank < 1) {
+    rank = 1;
+  }
+  uint64_t seen = 0;
+  for (size_t i = 0; i < HistogramBuckets; ++i) {
+    seen += atomic_load_explicit(&h->counts[i], memory_order_relaxed);
+    if (seen >= rank) {
+      return HistogramValue(i);
+    }
+  }
+  return atomic_load_explicit(&h->max, memory_order_relaxed);
+}
+
+static void PrintHistogram(FILE* file, const char* name, const Histogram* h) {
+  fprintf(file, "%s_ns count %llu p50 %llu p99 %llu p999 %llu max %llu\n", name,
+          (unsigned long long)atomic_load_explicit(&h->count,
+                                                   memory_order_relaxed),
+          (unsigned long long)HistogramPercentile(h, 0.5),
+          (unsigned long long)HistogramPercentile(h, 0.99),
+          (unsigned long long)HistogramPercentile(h, 0.999),
+          (unsigned long long)atomic_load_explicit(&h->max,
+                                                   memory_order_relaxed));
+}
+
+Stats g_stats;
+const char* g_stats_path;
+
+void CountEvent(_Atomic uint64_t* counter) {
+  atomic_fetch_add_explicit(counter, 1, memory_order_relaxed);
+}
+
+// Returns the number of bytes this process has written, which is (nearly)
+// all terminal output. Only Linux tells us; elsewhere, returns -1.
+static long long GetBytesWritten(void) {
+  FILE* io = fopen("/proc/self/io", "r");
+  if (io == NULL) {
+    return -1;
+  }
+  long long bytes = -1;
+  char line[128];
+  while (fgets(line, sizeof(line), io) != NULL) {
+    if (sscanf(line, "wchar: %lld", &bytes) == 1) {
+      break;
+    }
+  }
+  fclose(io);
+  return bytes;
+}
+
+void WriteStats(void) {
+  if (g_stats_path == NULL) {
+    return;
+  }
+  const long long bytes_written = GetBytesWritten();
+  FILE* file = fopen(g_stats_path, "w");
+  if (file == NULL) {
+    return;
+  }
+  fprintf(file, "keypresses %llu\n",
+          (unsigned long long)atomic_load_explicit(&g_stats.keypresses,
+                                                   memory_order_relaxed));
+  fprintf(file, "paints %llu\n",
+          (unsigned long long)atomic_load_explicit(&g_stats.paints,
+                                                   memory_order_relaxed));
+  fprintf(file, "full_redraws %llu\n",
+          (unsigned long long)atomic_load_explicit(&g_stats.full_redraws,
+                                                   memory_order_relaxed));
+  fprintf(file, "bytes_written %lld\n", bytes_written);
+  PrintHistogram(file, "input_to_update", &g_stats.input_to_update);
+  PrintHistogram(file, "update_to_paint", &g_stats.update_to_paint);
+  PrintHistogram(file, "input_to_paint", &g_stats.input_to_paint);
+  fclose(file);
+}
+
+// Set by SIGUSR1, for the main loop to write the statistics; see
+// HandleSignals.
+volatile sig_atomic_t g_stats_requested;
+
+void HandleStatsSignal(int signal) {
+  (void)signal;
+  g_stats_requested = true;
+}
+
+// Installs a handler without SA_RESTART, so that the signal interrupts
+// whatever system call the main loop is waiting in, and the loop gets to act
+// on it.
+void CatchSignal(int signal, void (*handler)(int)) {
+  struct sigaction action = {.sa_handler = handler};
+  sigemptyset(&action.sa_mask);
+  sigaction(signal, &action, NULL);
+}
+
+// Starts a thread with every signal blocked, so that signals are delivered
+// to the main thread, whose loop acts on them.
+int StartThread(pthread_t* thread, void* (*run)(void*)) {
+  sigset_t all;
+  sigset_t old;
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &old);
+  const int result = pthread_create(thread, NULL, run, NULL);
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+  return result;
+}
+
+static const char* const TracePhaseNames[] = {
+    [TracePhaseInput] = "getch",
+    [TracePhaseTouchTest] = "TouchTest",
+    [TracePhaseDrawItem] = "DrawItem",
+    [TracePhaseDrawMessage] = "DrawMessage",
+    [TracePhaseRedrawScreen] = "RedrawScreen",
+    [TracePhaseRefresh] = "refresh",
+    [TracePhaseHandleResize] = "HandleResize",
+    [TracePhaseAnimationFrame] = "PlayAnimation frame",
+    [TracePhaseTick] = "Tick",
+};
+
+typedef struct TraceSpan {
+  uint64_t start;
+  uint64_t duration;
+  TracePhase phase;
+} TraceSpan;
+
+static const size_t TraceCapacity = 1 << 16;
+
+static struct {
+  const char* path;
+  TraceSpan* spans;
+  uint64_t count;
+  uint64_t origin;
+} g_trace;
+
+// Returns the start time for a span, or 0 if tracing is off.
+uint64_t TraceBegin(void) {
+  return g_trace.spans == NULL ? 0 : Now();
+}
+
+void TraceEnd(TracePhase phase, uint64_t start) {
+  if (g_trace.spans == NULL) {
+    return;
+  }
+  TraceSpan* span = &g_trace.spans[g_trace.count % TraceCapacity];
+  span->start = start;
+  span->duration = Now() - start;
+  span->phase = phase;
+  ++g_trace.count;
+}
+
+static void WriteTrace(void) {
+  if (g_trace.spans == NULL) {
+    return;
+  }
+  FILE* file = fopen(g_trace.path, "w");
+  if (file == NULL) {
+    return;
+  }
+  const uint64_t first =
+      g_trace.count > TraceCapacity ? g_trace.count - TraceCapacity : 0;
+  fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+  for (uint64_t i = first; i < g_trace.count; ++i) {
+    const TraceSpan* span = &g_trace.spans[i % TraceCapacity];
+    fprintf(file,
+            "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%ld,\"tid\":1,"
+            "\"ts\":%.3f,\"dur\":%.3f}\n",
+            i == first ? "" : ",", TracePhaseNames[span->phase],
+            (long)getpid(), (double)(span->start - g_trace.origin) / 1000,
+            (double)span->duration / 1000);
+  }
+  fprintf(file, "]}\n");
+  fclose(file);
+}
+
+void StartTracing(const char* path) {
+  g_trace.path = path;
+  g_trace.spans = calloc(TraceCapacity, sizeof(TraceSpan));
+  if (g_trace.spans == NULL) {
+    fprintf(stderr, "Could not allocate the trace buffer!\n");
+    exit(EXIT_FAILURE);
+  }
+  g_trace.origin = Now();
+  atexit(WriteTrace);
+}
+
+enum {
+  EventRingCapacity = 1 << 12,
+  EventBatchSize = 256,
+};
+static const uint64_t EventLogIdleNanoseconds = 10 * 1000 * 1000;
+static const uint64_t EventLogSyncNanoseconds = 1000 * 1000 * 1000;
+
+static struct {
+  int fd;
+  pthread_t writer;
+  _Atomic bool stopping;
+  _Atomic uint64_t dropped;
+  uint64_t origin;
+  // Written only by the producer:
+  _Atomic uint64_t head;
+  // Written only by the writer thread:
+  _Atomic uint64_t tail;
+  Event events[EventRingCapacity];
+} g_event_log = {.fd = -1};
+
+void LogEvent(Event event) {
+  if (g_event_log.fd < 0) {
+    return;
+  }
+  const uint64_t head =
+      atomic_load_explicit(&g_event_log.head, memory_order_relaxed);
+  const uint64_t tail =
+      atomic_load_explicit(&g_event_log.tail, memory_order_acquire);
+  if (head - tail == EventRingCapacity) {
+    atomic_fetch_add_explicit(&g_event_log.dropped, 1, memory_order_relaxed);
+    return;
+  }
+  event.time = Now() - g_event_log.origin;
+  g_event_log.events[head % EventRingCapacity] = event;
+  atomic_store_explicit(&g_event_log.head, head + 1, memory_order_release);
+}
+
+static int FormatEvent(char* buffer, size_t size, const Event* e) {
+  const unsigned long long time = (unsigned long long)e->time;
+  const unsigned long long hash = (unsigned long long)e->hash;
+  switch (e->type) {
+    case EventTypeStart:
+      return snprintf(buffer, size,
+                      "{\"t\":%llu,\"event\":\"start\",\"seed\":%llu,"
+                      "\"items\":%zu,\"cols\":%d,\"lines\":%d,"
+                      "\"width\":%d,\"height\":%d,\"wander\":%d,"
+                      "\"hard\":%d,\"spacing\":%d,\"hash\":\"%016llx\"}\n",
+                      time, (unsigned long long)e->seed, e->item, e->x, e->y,
+                      e->width, e->height, e->items_wander, e->kitten_evades,
+                      e->spacing, hash);
+    case EventTypeMove:
+      return snprintf(buffer, size,
+                      "{\"t\":%llu,\"event\":\"move\",\"x\":%d,\"y\":%d,"
+                      "\"hash\":\"%016llx\"}\n",
+                      time, e->x, e->y, hash);
+    case EventTypeTouch:
+      return snprintf(buffer, size,
+                      "{\"t\":%llu,\"event\":\"touch\",\"x\":%d,\"y\":%d,"
+                      "\"item\":%zu,\"message\":%zu,\"hash\":\"%016llx\"}\n",
+                      time, e->x, e->y, e->item, e->message, hash);
+    case EventTypeResize:
+      return snprintf(buffer, size,
+                      "{\"t\":%llu,\"event\":\"resize\",\"cols\":%d,"
+                      "\"lines\":%d,\"width\":%d,\"height\":%d,"
+                      "\"hash\":\"%016llx\"}\n",
+                      time, e->x, e->y, e->width, e->height, hash);
+    case EventTypeWin:
+      return snprintf(buffer, size,
+                      "{\"t\":%llu,\"event\":\"win\",\"x\":%d,\"y\":%d,"
+                      "\"hash\":\"%016llx\"}\n",
+                      time, e->x, e->y, hash);
+    case EventTypeTick:
+      return snprintf(buffer, size,
+                      "{\"t\":%llu,\"event\":\"tick\",\"hash\":\"%016llx\"}\n",
+                      time, hash);
+  }
+  return 0;
+}
+
+void SyncFile(int fd) {
+#if defined(__APPLE__) && defined(__MACH__)
+  fsync(fd);
+#else
+  fdatasync(fd);
+#endif
+}
+
+// Formats and writes up to EventBatchSize events with a single write. Returns
+// the number of events written; any that did not fit in the batch are left
+// for the next.
+static size_t FlushEvents(void) {
+  // Most events take well under 160 bytes, and the longest, a start event,
+  // under 320.
+  static char batch[EventBatchSize * 160];
+  const uint64_t tail =
+      atomic_load_explicit(&g_event_log.tail, memory_order_relaxed);
+  const uint64_t head =
+      atomic_load_explicit(&g_event_log.head, memory_order_acquire);
+  size_t count = (size_t)(head - tail);
+  if (count > EventBatchSize) {
+    count = EventBatchSize;
+  }
+  size_t length = 0;
+  size_t formatted = 0;
+  for (; formatted < count; ++formatted) {
+    const Event* e =
+        &g_event_log.events[(tail + formatted) % EventRingCapacity];
+    const size_t room = sizeof(batch) - length;
+    const int n = FormatEvent(&batch[length], room, e);
+    if (n >= 0 && (size_t)n >= room) {
+      break;
+    }
+    if (n > 0) {
+      length += (size_t)n;
+    }
+  }
+  atomic_store_explicit(&g_event_log.tail, tail + formatted,
+                        memory_order_release);
+  for (size_t written = 0; written < length;) {
+    const ssize_t n = write(g_event_log.fd, &batch[written], length - written);
+    if (n <= 0) {
+      break;
+    }
+    written += (size_t)n;
+  }
+  return formatted;
+}
+
+static void* RunEventLogWriter(void* unused) {
+  (void)unused;
+  uint64_t last_sync = Now();
+  bool unsynced = false;
+  while (true) {
+    const bool stopping =
+        atomic_load_explicit(&g_event_log.stopping, memory_order_acquire);
+    const size_t written = FlushEvents();
+    unsynced = unsynced || written > 0;
+    if (unsynced &&
+        (stopping || Now() - last_sync >= EventLogSyncNanoseconds)) {
+      SyncFile(g_event_log.fd);
+      last_sync = Now();
+      unsynced = false;
+    }
+    if (stopping && written == 0) {
+      return NULL;
+    }
+    if (written < EventBatchSize) {
+      const struct timespec idle = {
+          .tv_nsec = (long)EventLogIdleNanoseconds,
+      };
+      nanosleep(&idle, NULL);
+    }
+  }
+}
+
+static void StopEventLog(void) {
+  if (g_event_log.fd < 0) {
+    return;
+  }
+  atomic_store_explicit(&g_event_log.stopping, true, memory_order_release);
+  pthread_join(g_event_log.writer, NULL);
+  close(g_event_log.fd);
+  g_event_log.fd = -1;
+  const uint64_t dropped =
+      atomic_load_explicit(&g_event_log.dropped, memory_order_relaxed);
+  if (dropped > 0) {
+    fprintf(stderr, "The event log dropped %llu events.\n",
+            (unsigned long long)dropped);
+  }
+}
+
+void StartEventLog(const char* path) {
+  g_event_log.fd =
+      open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (g_event_log.fd < 0) {
+    perror(path);
+    exit(EXIT_FAILURE);
+  }
+  g_event_log.origin = Now();
+  if (StartThread(&g_event_log.writer, RunEventLogWriter) != 0) {
+    fprintf(stderr, "Could not start the event log writer!\n");
+    exit(EXIT_FAILURE);
+  }
+  atexit(StopEventLog);
+}
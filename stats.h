@@ -0,0 +1,117 @@
+// Measuring robotfindskitten: the clocks, the latency histograms and
+// counters that --stats writes, the frame-phase trace that --trace writes,
+// and the event log that --event-log writes from a background thread.
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// A log-linear histogram, in the style of HdrHistogram. Values are grouped by
+// their highest set bit, and each such group is split into HistogramSubBuckets
+// linear sub-buckets, so a recorded value is off by at most 1 part in
+// HistogramSubBuckets. Recording is a relaxed atomic increment, so the
+// histogram can be read from a signal handler at any time.
+enum {
+  HistogramSubBucketBits = 5,
+  HistogramSubBuckets = 1 << HistogramSubBucketBits,
+  HistogramBuckets = (64 - HistogramSubBucketBits + 1) * HistogramSubBuckets,
+};
+
+typedef struct Histogram {
+  _Atomic uint64_t counts[HistogramBuckets];
+  _Atomic uint64_t count;
+  _Atomic uint64_t max;
+} Histogram;
+
+// Latency and rendering statistics, written to g_stats_path on exit or on
+// SIGUSR1, if the user asked for them.
+typedef struct Stats {
+  Histogram input_to_update;
+  Histogram update_to_paint;
+  Histogram input_to_paint;
+  _Atomic uint64_t keypresses;
+  _Atomic uint64_t paints;
+  _Atomic uint64_t full_redraws;
+} Stats;
+
+// Tracing records timed spans into a ring buffer that is allocated up front,
+// so that recording a span costs two clock reads and a store. The spans are
+// written out in Chrome trace-event format (chrome://tracing, Perfetto) at
+// exit. If the ring fills up, the oldest spans are overwritten.
+typedef enum TracePhase {
+  TracePhaseInput,
+  TracePhaseTouchTest,
+  TracePhaseDrawItem,
+  TracePhaseDrawMessage,
+  TracePhaseRedrawScreen,
+  TracePhaseRefresh,
+  TracePhaseHandleResize,
+  TracePhaseAnimationFrame,
+  TracePhaseTick,
+} TracePhase;
+
+// The event log records what happened in a game, one JSON object per line,
+// for offline analysis. MainLoop pushes events into a single-producer,
+// single-consumer ring, and a background thread formats them and writes them
+// to the log in batches, so that the input loop never waits for the disk. If
+// the writer falls behind far enough to fill the ring, new events are dropped
+// (and counted) rather than blocking the game.
+typedef enum EventType {
+  EventTypeStart,
+  EventTypeMove,
+  EventTypeTouch,
+  EventTypeResize,
+  EventTypeWin,
+  EventTypeTick,
+} EventType;
+
+// Every event records the game's hash after it, so that --replay can check
+// that replaying the events reproduces the game exactly.
+typedef struct Event {
+  uint64_t time;
+  EventType type;
+  int x;
+  int y;
+  // The size of the field, for start and resize events.
+  int width;
+  int height;
+  size_t item;
+  size_t message;
+  uint64_t seed;
+  bool items_wander;
+  bool kitten_evades;
+  int spacing;
+  uint64_t hash;
+} Event;
+
+extern Stats g_stats;
+extern const char* g_stats_path;
+extern volatile sig_atomic_t g_stats_requested;
+
+uint64_t Now(void);
+uint64_t GetThreadTime(void);
+uint64_t GetThreadTimeOverhead(void);
+void HistogramRecord(Histogram* h, uint64_t value);
+uint64_t HistogramPercentile(const Histogram* h, double fraction);
+void CountEvent(_Atomic uint64_t* counter);
+void WriteStats(void);
+void HandleStatsSignal(int signal);
+void CatchSignal(int signal, void (*handler)(int));
+int StartThread(pthread_t* thread, void* (*run)(void*));
+uint64_t TraceBegin(void);
+void TraceEnd(TracePhase phase, uint64_t start);
+void StartTracing(const char* path);
+void LogEvent(Event event);
+void SyncFile(int fd);
+void StartEventLog(const char* path);
+
+#endif  // STATS_H
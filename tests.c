@@ -0,0 +1,598 @@
+// Checks for `make check`. Each compares a fast part of the game with a
+// plain way of getting the same answer, over many seeded games, and reports
+// what differs.
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+
+#define _DARWIN_C_SOURCE
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 700
+#define _XOPEN_SOURCE_EXTENDED
+
+#include <locale.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "autopilot.h"
+#include "game.h"
+#include "path.h"
+#include "tools.h"
+
+// "nearest" and "sweep" must find Kitten in every game where there is a way
+// to it, however crowded the field. RunBenchmark reports the games where
+// they did not.
+static bool CheckAutopilot(void) {
+  static const struct {
+    int width;
+    int height;
+    size_t non_kitten_count;
+    int spacing;
+  } Fields[] = {
+      {80, 23, 20, 0},
+      {80, 23, 400, 0},
+      {40, 12, 150, 0},
+      {80, 23, 300, 3},
+  };
+  static const char* const Names[] = {"nearest", "sweep"};
+  bool passed = true;
+  for (size_t f = 0; f < COUNT(Fields); ++f) {
+    for (size_t n = 0; n < COUNT(Names); ++n) {
+      passed = RunBenchmark(FindStrategy(Names[n]), Fields[f].width,
+                            Fields[f].height, Fields[f].non_kitten_count,
+                            Fields[f].spacing, 1, 300) &&
+               passed;
+    }
+  }
+  return passed;
+}
+
+// Returns true if Robot could walk through (y, x) with --hard: it is inside
+// the frame, and no item other than Robot and Kitten covers it.
+static bool IsOpen(const Game* game, int y, int x) {
+  if (!IsInside(game, y, x, 1)) {
+    return false;
+  }
+  const uint32_t occupant = GetOccupant(game, y, x);
+  return occupant == 0 || occupant - 1 == Robot || occupant - 1 == Kitten;
+}
+
+// Fills `distances` with the number of steps from Robot to every cell, by
+// breadth-first search over the whole field.
+static void FindRobotDistances(const Game* game, uint32_t* distances,
+                               uint32_t* queue) {
+  const size_t cells = (size_t)game->width * (size_t)game->height;
+  for (size_t i = 0; i < cells; ++i) {
+    distances[i] = Infinity;
+  }
+  const Item* robot = &game->items[Robot];
+  size_t head = 0;
+  size_t tail = 0;
+  const uint32_t start = (uint32_t)GetCellIndex(game, robot->y, robot->x);
+  distances[start] = 0;
+  queue[tail++] = start;
+  while (head < tail) {
+    const uint32_t cell = queue[head++];
+    const int y = (int)(cell / (uint32_t)game->width);
+    const int x = (int)(cell % (uint32_t)game->width);
+    for (int d = 0; d < DirectionCount; ++d) {
+      const int next_y = y + Steps[d].dy;
+      const int next_x = x + Steps[d].dx;
+      if (!IsOpen(game, next_y, next_x)) {
+        continue;
+      }
+      const uint32_t next = (uint32_t)GetCellIndex(game, next_y, next_x);
+      if (distances[next] == Infinity) {
+        distances[next] = distances[cell] + 1;
+        queue[tail++] = next;
+      }
+    }
+  }
+}
+
+// Moves (y, x) to where Kitten should flee from there, by the rules of
+// MoveKitten, given Robot's distances to every cell.
+static void FindEscape(const Game* game, const uint32_t* distances, int* y,
+                       int* x) {
+  const int width = GetItemWidth(&game->items[Kitten]);
+  uint32_t best = distances[GetCellIndex(game, *y, *x)];
+  if (best > EarshotRange) {
+    return;
+  }
+  const int from_y = *y;
+  const int from_x = *x;
+  for (int d = 0; d < DirectionCount; ++d) {
+    const int next_y = from_y + Steps[d].dy;
+    const int next_x = from_x + Steps[d].dx;
+    if (!IsInside(game, next_y, next_x, width)) {
+      continue;
+    }
+    bool free = true;
+    for (int i = 0; i < width; ++i) {
+      const uint32_t occupant = GetOccupant(game, next_y, next_x + i);
+      free = free && (occupant == 0 || occupant - 1 == Kitten);
+    }
+    uint32_t distance = distances[GetCellIndex(game, next_y, next_x)];
+    if (distance > EarshotRange) {
+      distance = Infinity;
+    }
+    if (free && distance > best) {
+      best = distance;
+      *y = next_y;
+      *x = next_x;
+    }
+  }
+}
+
+// With --hard, Kitten must flee exactly as it would if its distance field
+// were searched from scratch every tick, rather than kept up to date by
+// D* Lite, while Robot chases it and the other items wander.
+static bool CheckEvasion(void) {
+  Game game;
+  if (!CreateGame(&game, 60, 20, 80)) {
+    return false;
+  }
+  game.items_wander = true;
+  game.kitten_evades = true;
+  const size_t cells = (size_t)game.width * (size_t)game.height;
+  uint32_t* distances = malloc(cells * sizeof(uint32_t));
+  uint32_t* queue = malloc(cells * sizeof(uint32_t));
+  if (distances == NULL || queue == NULL) {
+    return false;
+  }
+  Random random = {.state = 1};
+  uint64_t escapes = 0;
+  bool passed = true;
+  for (uint64_t seed = 1; seed <= 100 && passed; ++seed) {
+    ResetGame(&game, seed);
+    const Item* robot = &game.items[Robot];
+    const Item* kitten = &game.items[Kitten];
+    for (int tick = 0; tick < 500 && passed; ++tick) {
+      // Robot mostly heads for Kitten, so that Kitten has to run.
+      Direction d = GetDirection(kitten->y - robot->y, kitten->x - robot->x);
+      if (RandomBelow(&random, 4) == 0) {
+        d = (Direction)(int)RandomBelow(&random, DirectionCount);
+      }
+      size_t item_number = 0;
+      if (MoveRobot(&game, robot->y + Steps[d].dy, robot->x + Steps[d].dx,
+                    &item_number, NULL) == TouchTestResultKitten) {
+        break;
+      }
+      TickGame(&game);
+      int y = kitten->y;
+      int x = kitten->x;
+      for (size_t i = 0; i < game.move_count; ++i) {
+        if (game.moves[i].item == Kitten) {
+          y = game.moves[i].y;
+          x = game.moves[i].x;
+          ++escapes;
+        }
+      }
+      FindRobotDistances(&game, distances, queue);
+      FindEscape(&game, distances, &y, &x);
+      if (y != kitten->y || x != kitten->x) {
+        fprintf(stderr, "seed %llu, tick %d: Kitten went to (%d, %d), not "
+                "(%d, %d)\n", (unsigned long long)seed, tick, kitten->y,
+                kitten->x, y, x);
+        passed = false;
+      }
+    }
+  }
+  free(distances);
+  free(queue);
+  DestroyGame(&game);
+  if (escapes == 0) {
+    fprintf(stderr, "Kitten never ran from Robot\n");
+    passed = false;
+  }
+  return passed;
+}
+
+// Returns true if Robot could stand at (y, x) on its way to (goal_y, goal_x):
+// Robot fits there without covering another item, or it is the goal.
+static bool CanStandAt(const Game* game, int y, int x, int goal_y,
+                       int goal_x) {
+  const int width = GetItemWidth(&game->items[Robot]);
+  if (!IsInside(game, y, x, width)) {
+    return false;
+  }
+  if (y == goal_y && x == goal_x) {
+    return true;
+  }
+  for (int i = 0; i < width; ++i) {
+    const uint32_t occupant = GetOccupant(game, y, x + i);
+    if (occupant != 0 && occupant - 1 != Robot) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Returns the cost of the cheapest path for Robot to (goal_y, goal_x), by
+// Dijkstra's algorithm one step at a time, or Infinity if there is none.
+static uint32_t FindPathCost(const Game* game, CellHeap* heap, uint32_t* costs,
+                             int goal_y, int goal_x) {
+  const size_t cells = (size_t)game->width * (size_t)game->height;
+  for (size_t i = 0; i < cells; ++i) {
+    costs[i] = Infinity;
+  }
+  ClearCellHeap(heap);
+  const Item* robot = &game->items[Robot];
+  const uint32_t start = (uint32_t)GetCellIndex(game, robot->y, robot->x);
+  costs[start] = 0;
+  QueueCell(heap, start, 0);
+  while (heap->size > 0) {
+    const uint32_t cell = heap->cells[0];
+    DequeueCell(heap, cell);
+    const int y = (int)(cell / (uint32_t)game->width);
+    const int x = (int)(cell % (uint32_t)game->width);
+    if (y == goal_y && x == goal_x) {
+      return costs[cell];
+    }
+    for (int d = 0; d < DirectionCount; ++d) {
+      const int next_y = y + Steps[d].dy;
+      const int next_x = x + Steps[d].dx;
+      if (!CanStandAt(game, next_y, next_x, goal_y, goal_x)) {
+        continue;
+      }
+      const uint32_t next = (uint32_t)GetCellIndex(game, next_y, next_x);
+      const uint32_t cost =
+          costs[cell] + (d % 2 == 0 ? StraightCost : DiagonalCost);
+      if (cost < costs[next]) {
+        costs[next] = cost;
+        QueueCell(heap, next, cost);
+      }
+    }
+  }
+  return Infinity;
+}
+
+// Returns the cost of the path FindPath found, after checking that it goes
+// in straight lines between its jump points, only through cells Robot can
+// stand at, and ends at the goal. Returns Infinity if it does not.
+static uint32_t GetFoundPathCost(const Game* game, const PathFinder* finder,
+                                 int goal_y, int goal_x) {
+  int y = game->items[Robot].y;
+  int x = game->items[Robot].x;
+  uint32_t cost = 0;
+  for (size_t i = 0; i < finder->path_length; ++i) {
+    const int jump_y = (int)(finder->path[i] / (uint32_t)game->width);
+    const int jump_x = (int)(finder->path[i] % (uint32_t)game->width);
+    const int dy = Sign(jump_y - y);
+    const int dx = Sign(jump_x - x);
+    if ((dy != 0 && dx != 0 && abs(jump_y - y) != abs(jump_x - x)) ||
+        (dy == 0 && dx == 0)) {
+      return Infinity;
+    }
+    while (y != jump_y || x != jump_x) {
+      y += dy;
+      x += dx;
+      if (!CanStandAt(game, y, x, goal_y, goal_x)) {
+        return Infinity;
+      }
+      cost += dy != 0 && dx != 0 ? DiagonalCost : StraightCost;
+    }
+  }
+  return y == goal_y && x == goal_x ? cost : Infinity;
+}
+
+// Jump point search must find a path wherever there is one, as cheap as the
+// cheapest that Dijkstra's algorithm finds, to random cells and to items.
+static bool CheckPaths(void) {
+  static const struct {
+    int width;
+    int height;
+    size_t non_kitten_count;
+    uint64_t seed_count;
+  } Fields[] = {
+      {60, 20, 150, 50},
+      {80, 23, 400, 50},
+      {500, 200, 20000, 3},
+  };
+  Random random = {.state = 1};
+  bool passed = true;
+  for (size_t f = 0; f < COUNT(Fields) && passed; ++f) {
+    Game game;
+    if (!CreateGame(&game, Fields[f].width, Fields[f].height,
+                    Fields[f].non_kitten_count)) {
+      return false;
+    }
+    const size_t cells = (size_t)game.width * (size_t)game.height;
+    uint32_t* costs = malloc(cells * sizeof(uint32_t));
+    CellHeap heap = {0};
+    PathFinder finder = {0};
+    if (costs == NULL || !AllocateCellHeap(&heap, cells)) {
+      return false;
+    }
+    for (uint64_t seed = 1; seed <= Fields[f].seed_count && passed; ++seed) {
+      ResetGame(&game, seed);
+      for (int query = 0; query < 40 && passed; ++query) {
+        int y;
+        int x;
+        if (query % 2 == 0) {
+          y = (int)RandomBelow(&random, (uint32_t)game.height);
+          x = (int)RandomBelow(&random, (uint32_t)game.width);
+        } else {
+          const Item* item = &game.items[RandomBelow(
+              &random, (uint32_t)game.item_count)];
+          y = item->y;
+          x = item->x;
+        }
+        const uint32_t expected = FindPathCost(&game, &heap, costs, y, x);
+        const uint32_t cost = FindPath(&finder, &game, y, x)
+                                  ? GetFoundPathCost(&game, &finder, y, x)
+                                  : Infinity;
+        if (cost != expected) {
+          fprintf(stderr, "seed %llu, %dx%d: the path to (%d, %d) cost %u, "
+                  "not %u\n", (unsigned long long)seed, game.width,
+                  game.height, y, x, cost, expected);
+          passed = false;
+        }
+      }
+    }
+    free(costs);
+    FreeCellHeap(&heap);
+    FreePathFinder(&finder);
+    DestroyGame(&game);
+  }
+  return passed;
+}
+
+// The game's hash must change whenever Robot moves, touches something new,
+// or an item wanders, and must match the hash RestoreGame computes from
+// scratch, as it checks, after any number of moves.
+static bool CheckHash(void) {
+  char path[] = "/tmp/robotfindskitten-XXXXXX";
+  const int fd = mkstemp(path);
+  if (fd < 0) {
+    perror(path);
+    return false;
+  }
+  close(fd);
+  Game game;
+  if (!CreateGame(&game, 80, 23, 200)) {
+    return false;
+  }
+  game.items_wander = true;
+  game.kitten_evades = true;
+  Random random = {.state = 1};
+  bool passed = true;
+  for (uint64_t seed = 1; seed <= 50 && passed; ++seed) {
+    ResetGame(&game, seed);
+    const Item* robot = &game.items[Robot];
+    bool found = false;
+    for (int move = 1; move <= 1000 && !found && passed; ++move) {
+      const uint64_t hash = game.hash;
+      const int y = robot->y;
+      const int x = robot->x;
+      const Direction d = (Direction)(int)RandomBelow(&random, DirectionCount);
+      size_t item_number = 0;
+      bool first_touch = false;
+      found = MoveRobot(&game, y + Steps[d].dy, x + Steps[d].dx, &item_number,
+                        &first_touch) == TouchTestResultKitten;
+      TickGame(&game);
+      const bool changed = robot->y != y || robot->x != x || first_touch ||
+                           game.move_count > 0;
+      if (changed == (game.hash == hash)) {
+        fprintf(stderr, "seed %llu, move %d: the hash %s\n",
+                (unsigned long long)seed, move,
+                changed ? "did not change" : "changed");
+        passed = false;
+      }
+      if (move % 100 == 0 || found) {
+        Game restored;
+        if (!SaveGame(&game, path) || !RestoreGame(&restored, path)) {
+          fprintf(stderr, "seed %llu, move %d: the hash is wrong\n",
+                  (unsigned long long)seed, move);
+          passed = false;
+          continue;
+        }
+        DestroyGame(&restored);
+      }
+    }
+  }
+  unlink(path);
+  DestroyGame(&game);
+  return passed;
+}
+
+// Returns true if every item is inside the frame, and covers the cells it
+// should and no others.
+static bool ItemsAreOnField(const Game* game) {
+  size_t covered = 0;
+  for (size_t i = 0; i < game->item_count; ++i) {
+    const Item* item = &game->items[i];
+    const int width = GetItemWidth(item);
+    if (!IsInside(game, item->y, item->x, width)) {
+      return false;
+    }
+    for (int j = 0; j < width; ++j) {
+      if (GetOccupant(game, item->y, item->x + j) != i + 1) {
+        return false;
+      }
+    }
+    covered += (size_t)width;
+  }
+  size_t occupied = 0;
+  for (int y = 0; y < game->height; ++y) {
+    for (int x = 0; x < game->width; ++x) {
+      occupied += GetOccupant(game, y, x) != 0;
+    }
+  }
+  return occupied == covered;
+}
+
+// With --spacing, no two items may be closer than the spacing, counting a
+// row as two columns, when the field has room for them all; when it does
+// not, the items must still all be placed.
+static bool CheckSpacing(void) {
+  static const struct {
+    int width;
+    int height;
+    size_t non_kitten_count;
+    int spacing;
+    bool fits;
+  } Fields[] = {
+      {80, 23, 60, 4, true},
+      {80, 23, 20, 8, true},
+      {200, 60, 200, 6, true},
+      {80, 23, 600, 8, false},
+  };
+  bool passed = true;
+  for (size_t f = 0; f < COUNT(Fields) && passed; ++f) {
+    Game game;
+    if (!CreateGame(&game, Fields[f].width, Fields[f].height,
+                    Fields[f].non_kitten_count)) {
+      return false;
+    }
+    game.sampler.spacing = Fields[f].spacing;
+    const int64_t spacing = Fields[f].spacing;
+    for (uint64_t seed = 1; seed <= 100 && passed; ++seed) {
+      ResetGame(&game, seed);
+      if (!ItemsAreOnField(&game)) {
+        fprintf(stderr, "seed %llu, %dx%d: the items are misplaced\n",
+                (unsigned long long)seed, game.width, game.height);
+        passed = false;
+      }
+      for (size_t i = 0; i < game.item_count && Fields[f].fits && passed;
+           ++i) {
+        for (size_t j = i + 1; j < game.item_count && passed; ++j) {
+          const int64_t dy = game.items[i].y - game.items[j].y;
+          const int64_t dx = game.items[i].x - game.items[j].x;
+          if (dx * dx + 4 * dy * dy < spacing * spacing) {
+            fprintf(stderr, "seed %llu, %dx%d: items %zu and %zu are too "
+                    "close\n", (unsigned long long)seed, game.width,
+                    game.height, i, j);
+            passed = false;
+          }
+        }
+      }
+    }
+    DestroyGame(&game);
+  }
+  return passed;
+}
+
+// Counts the items other than Robot within `radius` of (y, x) that are in
+// `area`, by looking at every one.
+static uint64_t CountItemsLinearly(const Game* game, int y, int x, int radius,
+                                   Box area) {
+  uint64_t count = 0;
+  for (size_t i = Kitten; i < game->item_count; ++i) {
+    const Item* item = &game->items[i];
+    const int64_t dy = item->y - y;
+    const int64_t dx = item->x - x;
+    count += item->y >= area.top && item->y < area.bottom &&
+             item->x >= area.left && item->x < area.right &&
+             dy * dy + dx * dx <= (int64_t)radius * radius;
+  }
+  return count;
+}
+
+// Sonar must count the same items as a linear scan, for any radius, from
+// anywhere, and in any part of the field, as the items wander, and the four
+// quadrants the sonar key reports must add up to the whole.
+static bool CheckSonar(void) {
+  static const struct {
+    int width;
+    int height;
+    size_t non_kitten_count;
+    uint64_t seed_count;
+  } Fields[] = {
+      {80, 23, 200, 20},
+      {500, 200, 20000, 5},
+      {1000, 1000, 100000, 1},
+  };
+  Random random = {.state = 1};
+  bool passed = true;
+  for (size_t f = 0; f < COUNT(Fields) && passed; ++f) {
+    Game game;
+    if (!CreateGame(&game, Fields[f].width, Fields[f].height,
+                    Fields[f].non_kitten_count)) {
+      return false;
+    }
+    game.items_wander = true;
+    const uint32_t width = (uint32_t)game.width;
+    const uint32_t height = (uint32_t)game.height;
+    for (uint64_t seed = 1; seed <= Fields[f].seed_count && passed; ++seed) {
+      ResetGame(&game, seed);
+      for (int ping = 0; ping < 100 && passed; ++ping) {
+        TickGame(&game);
+        // Half the pings are from Robot, as with the sonar key.
+        const Item* robot = &game.items[Robot];
+        const bool from_robot = ping % 2 == 0;
+        const int y = from_robot ? robot->y : (int)RandomBelow(&random, height);
+        const int x = from_robot ? robot->x : (int)RandomBelow(&random, width);
+        const int radius = (int)RandomBelow(&random, width);
+        const int top = (int)RandomBelow(&random, height);
+        const int left = (int)RandomBelow(&random, width);
+        const Box areas[] = {
+            {.top = 0, .left = 0, .bottom = game.height, .right = game.width},
+            {.top = top,
+             .left = left,
+             .bottom = top + (int)RandomBelow(&random, height),
+             .right = left + (int)RandomBelow(&random, width)},
+            // The quadrants, as the sonar key splits them.
+            {.top = 0, .left = x, .bottom = y, .right = game.width},
+            {.top = y,
+             .left = x + 1,
+             .bottom = game.height,
+             .right = game.width},
+            {.top = y + 1, .left = 0, .bottom = game.height, .right = x + 1},
+            {.top = 0, .left = 0, .bottom = y + 1, .right = x},
+        };
+        uint64_t counts[COUNT(areas)];
+        for (size_t a = 0; a < COUNT(areas); ++a) {
+          counts[a] = CountItemsNear(&game, y, x, radius, areas[a]);
+          const uint64_t expected =
+              CountItemsLinearly(&game, y, x, radius, areas[a]);
+          if (counts[a] != expected) {
+            fprintf(stderr, "seed %llu, %dx%d: sonar at (%d, %d) in range "
+                    "%d counted %llu items, not %llu\n",
+                    (unsigned long long)seed, game.width, game.height, y, x,
+                    radius, (unsigned long long)counts[a],
+                    (unsigned long long)expected);
+            passed = false;
+          }
+        }
+        if (from_robot &&
+            counts[2] + counts[3] + counts[4] + counts[5] != counts[0]) {
+          fprintf(stderr, "seed %llu, %dx%d: the quadrants around (%d, %d) "
+                  "do not add up\n", (unsigned long long)seed, game.width,
+                  game.height, y, x);
+          passed = false;
+        }
+      }
+    }
+    DestroyGame(&game);
+  }
+  return passed;
+}
+
+static const struct {
+  const char* name;
+  bool (*run)(void);
+} Checks[] = {
+    {"autopilot", CheckAutopilot},
+    {"evasion", CheckEvasion},
+    {"hash", CheckHash},
+    {"paths", CheckPaths},
+    {"sonar", CheckSonar},
+    {"spacing", CheckSpacing},
+};
+
+int main(void) {
+  setlocale(LC_ALL, "");
+  MeasureIcons();
+  bool passed = true;
+  for (size_t i = 0; i < COUNT(Checks); ++i) {
+    const bool ok = Checks[i].run();
+    printf("%s: %s\n", Checks[i].name, ok ? "ok" : "FAILED");
+    passed = passed && ok;
+  }
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,712 @@
+// This program is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+
+#define _DARWIN_C_SOURCE
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 700
+#define _XOPEN_SOURCE_EXTENDED
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdnoreturn.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "autopilot.h"
+#include "game.h"
+#include "path.h"
+#include "robotfindskitten.h"
+#include "stats.h"
+#include "tools.h"
+
+// Plays `seed_count` games, starting at `first_seed`, with each strategy (or
+// just `only`, if given), and prints how many moves Robot took to find Kitten
+// and how much CPU time each decision took. A game that takes more than a
+// generous number of moves counts as a failure, unless a crowded field has
+// walled Kitten in, so that no strategy could find it. Returns false if there
+// were any failures. Decisions are timed with the thread's CPU clock, so that
+// time the thread spends preempted or waiting does not count. Reading it may
+// take a system call, so the least time a reading adds is measured first and
+// taken off every decision's time.
+bool RunBenchmark(const Strategy* only, int width, int height,
+                  size_t non_kitten_count, int spacing, uint64_t first_seed,
+                  uint64_t seed_count) {
+  Game game;
+  if (!CreateGame(&game, width, height, non_kitten_count)) {
+    fprintf(stderr, "The field is too small to fit all objects!\n");
+    exit(EXIT_FAILURE);
+  }
+  game.sampler.spacing = spacing;
+  Histogram* moves = calloc(1, sizeof(Histogram));
+  Histogram* decisions = calloc(1, sizeof(Histogram));
+  if (moves == NULL || decisions == NULL) {
+    fprintf(stderr, "Out of memory!\n");
+    exit(EXIT_FAILURE);
+  }
+  const uint64_t move_limit = 50 * (uint64_t)(width - 2 * FrameThickness) *
+                              (uint64_t)(height - 2 * FrameThickness);
+  printf("field %dx%d, %zu items, seeds %llu to %llu\n", width, height,
+         game.item_count, (unsigned long long)first_seed,
+         (unsigned long long)(first_seed + seed_count - 1));
+
+  const uint64_t overhead = GetThreadTimeOverhead();
+  const Strategy* strategies = only != NULL ? only : Strategies;
+  const size_t strategy_count = only != NULL ? 1 : StrategyCount;
+  bool passed = true;
+  for (size_t s = 0; s < strategy_count; ++s) {
+    const Strategy* strategy = &strategies[s];
+    memset(moves, 0, sizeof(*moves));
+    memset(decisions, 0, sizeof(*decisions));
+    uint64_t total_moves = 0;
+    uint64_t total_time = 0;
+    uint64_t failures = 0;
+    uint64_t walled_in = 0;
+    // The hashes of every game's end, folded together, so that runs on
+    // different machines or compilers can be compared.
+    uint64_t digest = 0;
+    for (uint64_t seed = first_seed; seed < first_seed + seed_count; ++seed) {
+      ResetGame(&game, seed);
+      Autopilot autopilot;
+      ResetAutopilot(&autopilot, strategy, &game);
+      uint64_t move = 0;
+      bool found = false;
+      while (!found && move < move_limit) {
+        const uint64_t start = GetThreadTime();
+        const Direction d = DecideMove(&autopilot, &game);
+        const uint64_t measured = GetThreadTime() - start;
+        const uint64_t elapsed = measured > overhead ? measured - overhead : 0;
+        HistogramRecord(decisions, elapsed);
+        total_time += elapsed;
+        ++move;
+
+        const Item* robot = &game.items[Robot];
+        size_t item_number = 0;
+        found = MoveRobot(&game, robot->y + Steps[d].dy,
+                          robot->x + Steps[d].dx,
+                          &item_number, NULL) == TouchTestResultKitten;
+      }
+      FinishAutopilot(&autopilot);
+      digest = MixBits(digest ^ game.hash);
+      if (found) {
+        HistogramRecord(moves, move);
+        total_moves += move;
+      } else if (CanReachItem(&game.paths, &game, Kitten)) {
+        ++failures;
+      } else {
+        ++walled_in;
+      }
+    }
+
+    const uint64_t found_count =
+        atomic_load_explicit(&moves->count, memory_order_relaxed);
+    const uint64_t decision_count =
+        atomic_load_explicit(&decisions->count, memory_order_relaxed);
+    printf(
+        "%-8s moves mean %.1f p50 %llu p99 %llu max %llu failures %llu "
+        "walled_in %llu, decision_ns mean %.0f p99 %llu, hash %016llx\n",
+        strategy->name,
+        found_count > 0 ? (double)total_moves / (double)found_count : 0.0,
+        (unsigned long long)HistogramPercentile(moves, 0.5),
+        (unsigned long long)HistogramPercentile(moves, 0.99),
+        (unsigned long long)atomic_load_explicit(&moves->max,
+                                                 memory_order_relaxed),
+        (unsigned long long)failures, (unsigned long long)walled_in,
+        decision_count > 0 ? (double)total_time / (double)decision_count : 0.0,
+        (unsigned long long)HistogramPercentile(decisions, 0.99),
+        (unsigned long long)digest);
+    if (failures > 0) {
+      fprintf(stderr, "%s failed to find Kitten %llu times!\n", strategy->name,
+              (unsigned long long)failures);
+      passed = false;
+    }
+  }
+  free(moves);
+  free(decisions);
+  DestroyGame(&game);
+  return passed;
+}
+
+// With --find-seeds, many seeds are dealt out just as a game would deal them,
+// with no terminal, and each field is scored by what Kitten's surroundings
+// look like, so that seeds for special occasions can be picked out and then
+// played with -s. The seeds are shared among one thread per processor, in
+// chunks that each thread takes as it finishes its last, and each thread
+// keeps its own best few. Ties go to the lower seed, so the result does not
+// depend on how the chunks fell.
+typedef enum Metric {
+  // The number of steps from Robot to Kitten, going around the other items,
+  // or -1 if there is no way through.
+  MetricDistance,
+  // The percentage of the cells next to Kitten, inside the frame, that
+  // other items cover.
+  MetricEnclosure,
+  // The same, for the cells within DensityRadius of Kitten.
+  MetricDensity,
+  MetricCount,
+} Metric;
+
+static const char* const MetricNames[MetricCount] = {
+    [MetricDistance] = "distance",
+    [MetricEnclosure] = "enclosure",
+    [MetricDensity] = "density",
+};
+
+enum { MaximumMetrics = 4, DensityRadius = 5, SeedChunkSize = 1 << 12 };
+
+typedef struct SeedScore {
+  uint64_t seed;
+  double scores[MaximumMetrics];
+} SeedScore;
+
+typedef struct SeedSearch {
+  int width;
+  int height;
+  size_t non_kitten_count;
+  int spacing;
+  uint64_t first_seed;
+  uint64_t seed_count;
+  // Seeds are ranked by the first metric, then the next, and so on; `signs`
+  // are 1 for metrics where more is better, and -1 where less is.
+  Metric metrics[MaximumMetrics];
+  double signs[MaximumMetrics];
+  size_t metric_count;
+  size_t top_count;
+  // The offset from first_seed of the next chunk to search.
+  _Atomic uint64_t next;
+} SeedSearch;
+
+typedef struct SeedFinder {
+  SeedSearch* search;
+  pthread_t thread;
+  // The best `count` seeds this thread has found, best first.
+  SeedScore* best;
+  size_t count;
+  bool failed;
+} SeedFinder;
+
+// Parses a comma-separated list of metric names, each of which may start
+// with "-" to prefer low values.
+static bool ParseMetrics(SeedSearch* search, const char* list) {
+  search->metric_count = 0;
+  while (true) {
+    if (search->metric_count == MaximumMetrics) {
+      return false;
+    }
+    double sign = 1;
+    if (*list == '-') {
+      sign = -1;
+      ++list;
+    }
+    const size_t length = strcspn(list, ",");
+    size_t m = 0;
+    while (m < MetricCount && (strlen(MetricNames[m]) != length ||
+                               strncmp(MetricNames[m], list, length) != 0)) {
+      ++m;
+    }
+    if (m == MetricCount) {
+      return false;
+    }
+    search->metrics[search->metric_count] = (Metric)m;
+    search->signs[search->metric_count] = sign;
+    ++search->metric_count;
+    if (list[length] == '\0') {
+      return true;
+    }
+    list += length + 1;
+  }
+}
+
+// Returns the percentage of the cells within `radius` of Kitten, inside the
+// frame, that items other than Robot and Kitten cover.
+static double GetCrowding(const Game* game, int radius) {
+  const Item* kitten = &game->items[Kitten];
+  const int width = GetItemWidth(kitten);
+  const int top = kitten->y - radius > FrameThickness ? kitten->y - radius
+                                                      : FrameThickness;
+  const int bottom = kitten->y + radius < game->height - FrameThickness
+                         ? kitten->y + radius
+                         : game->height - FrameThickness - 1;
+  const int left = kitten->x - radius > FrameThickness ? kitten->x - radius
+                                                       : FrameThickness;
+  const int right = kitten->x + width + radius < game->width - FrameThickness
+                        ? kitten->x + width - 1 + radius
+                        : game->width - FrameThickness - 1;
+  int cells = 0;
+  int covered = 0;
+  for (int y = top; y <= bottom; ++y) {
+    for (int x = left; x <= right; ++x) {
+      const uint32_t occupant = GetOccupant(game, y, x);
+      if (occupant - 1 == Kitten) {
+        continue;
+      }
+      ++cells;
+      covered += occupant != 0 && occupant - 1 != Robot;
+    }
+  }
+  return cells > 0 ? 100.0 * covered / cells : 0.0;
+}
+
+static double GetMetric(Game* game, Metric metric) {
+  switch (metric) {
+    case MetricDistance: {
+      const uint32_t distance = GetKittenDistance(game);
+      return distance == Infinity ? -1.0 : (double)distance;
+    }
+    case MetricEnclosure:
+      return GetCrowding(game, 1);
+    case MetricDensity:
+      return GetCrowding(game, DensityRadius);
+    case MetricCount:
+      break;
+  }
+  return 0.0;
+}
+
+static bool IsBetterSeed(const SeedSearch* search, const SeedScore* a,
+                         const SeedScore* b) {
+  for (size_t i = 0; i < search->metric_count; ++i) {
+    const double a_score = search->signs[i] * a->scores[i];
+    const double b_score = search->signs[i] * b->scores[i];
+    if (a_score > b_score) {
+      return true;
+    }
+    if (a_score < b_score) {
+      return false;
+    }
+  }
+  return a->seed < b->seed;
+}
+
+// Adds `score` to the finder's best seeds, in order, if it is good enough.
+static void KeepIfBetter(SeedFinder* finder, const SeedScore* score) {
+  const SeedSearch* search = finder->search;
+  size_t i = finder->count;
+  if (i == search->top_count) {
+    if (!IsBetterSeed(search, score, &finder->best[i - 1])) {
+      return;
+    }
+    --i;
+  } else {
+    ++finder->count;
+  }
+  while (i > 0 && IsBetterSeed(search, score, &finder->best[i - 1])) {
+    finder->best[i] = finder->best[i - 1];
+    --i;
+  }
+  finder->best[i] = *score;
+}
+
+static void* RunSeedFinder(void* opaque_finder) {
+  SeedFinder* finder = opaque_finder;
+  SeedSearch* search = finder->search;
+  Game game;
+  if (!CreateGame(&game, search->width, search->height,
+                  search->non_kitten_count)) {
+    finder->failed = true;
+    return NULL;
+  }
+  game.sampler.spacing = search->spacing;
+  while (true) {
+    const uint64_t start = atomic_fetch_add_explicit(
+        &search->next, SeedChunkSize, memory_order_relaxed);
+    if (start >= search->seed_count) {
+      break;
+    }
+    const uint64_t end = search->seed_count - start > SeedChunkSize
+                             ? start + SeedChunkSize
+                             : search->seed_count;
+    for (uint64_t offset = start; offset < end; ++offset) {
+      SeedScore score = {.seed = search->first_seed + offset};
+      ResetGame(&game, score.seed);
+      for (size_t i = 0; i < search->metric_count; ++i) {
+        score.scores[i] = GetMetric(&game, search->metrics[i]);
+      }
+      KeepIfBetter(finder, &score);
+    }
+  }
+  DestroyGame(&game);
+  return NULL;
+}
+
+// Searches `seed_count` seeds, starting at `first_seed`, and prints the
+// `top_count` best by the metrics in `metric_list`.
+void RunSeedSearch(int width, int height, size_t non_kitten_count, int spacing,
+                   uint64_t first_seed, uint64_t seed_count,
+                   const char* metric_list, size_t top_count) {
+  SeedSearch search = {
+      .width = width,
+      .height = height,
+      .non_kitten_count = non_kitten_count,
+      .spacing = spacing,
+      .first_seed = first_seed,
+      .seed_count = seed_count,
+      .top_count = top_count > 0 ? top_count : 1,
+  };
+  if (!ParseMetrics(&search, metric_list)) {
+    fprintf(stderr, "Bad metrics: %s\n", metric_list);
+    exit(EXIT_FAILURE);
+  }
+  if (!FieldCanHold(width, height, Bogus + non_kitten_count)) {
+    fprintf(stderr, "The field is too small to fit all objects!\n");
+    exit(EXIT_FAILURE);
+  }
+  const long processors = sysconf(_SC_NPROCESSORS_ONLN);
+  const uint64_t chunks = (seed_count + SeedChunkSize - 1) / SeedChunkSize;
+  size_t thread_count = processors > 0 ? (size_t)processors : 1;
+  if (thread_count > chunks) {
+    thread_count = (size_t)chunks;
+  }
+  SeedFinder* finders = calloc(thread_count, sizeof(SeedFinder));
+  SeedScore* best =
+      calloc(thread_count + 1, search.top_count * sizeof(SeedScore));
+  if (finders == NULL || best == NULL) {
+    fprintf(stderr, "Out of memory!\n");
+    exit(EXIT_FAILURE);
+  }
+
+  const uint64_t start = Now();
+  for (size_t i = 0; i < thread_count; ++i) {
+    finders[i].search = &search;
+    finders[i].best = &best[(i + 1) * search.top_count];
+    if (pthread_create(&finders[i].thread, NULL, RunSeedFinder,
+                       &finders[i]) != 0) {
+      fprintf(stderr, "Could not start a thread!\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  // The first top_count entries of `best` gather every thread's best.
+  SeedFinder merged = {.search = &search, .best = best};
+  for (size_t i = 0; i < thread_count; ++i) {
+    pthread_join(finders[i].thread, NULL);
+    if (finders[i].failed) {
+      fprintf(stderr, "Out of memory!\n");
+      exit(EXIT_FAILURE);
+    }
+    for (size_t j = 0; j < finders[i].count; ++j) {
+      KeepIfBetter(&merged, &finders[i].best[j]);
+    }
+  }
+  const uint64_t elapsed = Now() - start;
+
+  printf("field %dx%d, %zu items, seeds %llu to %llu, %zu threads, %.3f s\n",
+         width, height, Bogus + non_kitten_count,
+         (unsigned long long)first_seed,
+         (unsigned long long)(first_seed + seed_count - 1), thread_count,
+         (double)elapsed / 1e9);
+  for (size_t i = 0; i < merged.count; ++i) {
+    printf("seed %llu", (unsigned long long)best[i].seed);
+    for (size_t j = 0; j < search.metric_count; ++j) {
+      printf(" %s %g", MetricNames[search.metrics[j]], best[i].scores[j]);
+    }
+    printf("\n");
+  }
+  free(finders);
+  free(best);
+}
+
+// With --protocol, a bot in another process plays over stdin and stdout, with
+// no terminal at all. Every line the bot sends gets exactly one line back:
+//
+//   A line of moves, such as "lljjn", in the NetHack direction keys. The
+//   reply has one token per move: "." if Robot moved, "#" if it was
+//   blocked, "t<item>:<message>" if it touched a non-kitten item, "?" if the
+//   move was not a direction key, and "K" if it found Kitten, which ends the
+//   game; any moves after that are ignored. Once the game is over, moves get
+//   the reply "over".
+//
+//   "reset [seed]" starts a new game, with the next seed if none is given.
+//   The reply is the new field: "field <width> <height> <seed> <items>",
+//   followed by "<x>,<y>,<width>" for each item, Robot first. Item numbers
+//   mean the same as in the bot API.
+//
+//   "hash" gets the reply "hash <hex>", the game's hash (see GetItemKey),
+//   which is the same for the same game and moves on every platform.
+//
+//   "quit" ends the session, as does the end of input.
+//
+// The field is also sent once at the start. Bots may send many lines without
+// waiting for replies. Replies are buffered, and flushed whenever all of the
+// input received so far has been answered, so a pipelined batch costs one
+// write rather than one per line.
+typedef struct ProtocolSession {
+  RfkGame* game;
+  uint64_t seed;
+  bool over;
+} ProtocolSession;
+
+static void SendField(ProtocolSession* session) {
+  const size_t count = Api.get_item_count(session->game);
+  int width;
+  int height;
+  Api.get_size(session->game, &width, &height);
+  printf("field %d %d %llu %zu", width, height,
+         (unsigned long long)session->seed, count);
+  for (size_t i = 0; i < count; ++i) {
+    const RfkItem item = Api.get_item(session->game, i);
+    printf(" %d,%d,%d", item.x, item.y, item.width);
+  }
+  putchar('\n');
+}
+
+static bool GetMoveDirection(char move, RfkDirection* direction) {
+  switch (move) {
+    case NetHack_up:
+      *direction = RfkDirectionUp;
+      return true;
+    case NetHack_up_right:
+      *direction = RfkDirectionUpRight;
+      return true;
+    case NetHack_right:
+      *direction = RfkDirectionRight;
+      return true;
+    case NetHack_down_right:
+      *direction = RfkDirectionDownRight;
+      return true;
+    case NetHack_down:
+      *direction = RfkDirectionDown;
+      return true;
+    case NetHack_down_left:
+      *direction = RfkDirectionDownLeft;
+      return true;
+    case NetHack_left:
+      *direction = RfkDirectionLeft;
+      return true;
+    case NetHack_up_left:
+      *direction = RfkDirectionUpLeft;
+      return true;
+    default:
+      return false;
+  }
+}
+
+static void HandleMoves(ProtocolSession* session, const char* moves) {
+  if (session->over) {
+    puts("over");
+    return;
+  }
+  const char* separator = "";
+  for (const char* move = moves; *move != '\0' && !session->over; ++move) {
+    fputs(separator, stdout);
+    separator = " ";
+    RfkDirection direction;
+    if (!GetMoveDirection(*move, &direction)) {
+      putchar('?');
+      continue;
+    }
+    size_t item = 0;
+    switch (Api.step(session->game, direction, &item)) {
+      case RfkResultMoved:
+        putchar('.');
+        break;
+      case RfkResultBlocked:
+        putchar('#');
+        break;
+      case RfkResultTouched:
+        printf("t%zu:%d", item, Api.get_item(session->game, item).message);
+        break;
+      case RfkResultKitten:
+        putchar('K');
+        session->over = true;
+        break;
+    }
+  }
+  putchar('\n');
+}
+
+// Handles one line of input. Returns false if the session should end.
+static bool HandleProtocolLine(ProtocolSession* session, const char* line) {
+  if (StringsEqual(line, "quit")) {
+    return false;
+  }
+  if (StringsEqual(line, "hash")) {
+    printf("hash %016llx\n",
+           (unsigned long long)FromRfkGame(session->game)->hash);
+    return true;
+  }
+  if (strncmp(line, "reset", 5) == 0 && (line[5] == '\0' || line[5] == ' ')) {
+    char* end;
+    const uint64_t seed = strtoull(&line[5], &end, 0);
+    session->seed = end == &line[5] ? session->seed + 1 : seed;
+    Api.reset(session->game, session->seed);
+    session->over = false;
+    SendField(session);
+    return true;
+  }
+  HandleMoves(session, line);
+  return true;
+}
+
+void RunProtocol(int width, int height, size_t non_kitten_count,
+                 uint64_t seed) {
+  ProtocolSession session = {
+      .game = Api.create_game(width, height, non_kitten_count),
+      .seed = seed,
+  };
+  if (session.game == NULL) {
+    fprintf(stderr, "The field is too small to fit all objects!\n");
+    exit(EXIT_FAILURE);
+  }
+  Api.reset(session.game, seed);
+  static char output[1 << 16];
+  setvbuf(stdout, output, _IOFBF, sizeof(output));
+  SendField(&session);
+  fflush(stdout);
+
+  size_t capacity = 1 << 16;
+  size_t length = 0;
+  char* input = malloc(capacity);
+  bool running = input != NULL;
+  while (running) {
+    if (length == capacity) {
+      capacity *= 2;
+      char* bigger = realloc(input, capacity);
+      if (bigger == NULL) {
+        break;
+      }
+      input = bigger;
+    }
+    const ssize_t n = read(STDIN_FILENO, &input[length], capacity - length);
+    if (n < 0) {
+      break;
+    }
+    if (n == 0) {
+      // The last line may have no newline. There is room for its '\0', since
+      // the read had room for at least 1 more byte.
+      if (length > 0) {
+        input[length] = '\0';
+        if (input[length - 1] == '\r') {
+          input[length - 1] = '\0';
+        }
+        HandleProtocolLine(&session, input);
+        fflush(stdout);
+      }
+      break;
+    }
+    length += (size_t)n;
+
+    // Answer every complete line we have, then flush once.
+    size_t start = 0;
+    char* newline;
+    while (running &&
+           (newline = memchr(&input[start], '\n', length - start)) != NULL) {
+      *newline = '\0';
+      if (newline > &input[start] && newline[-1] == '\r') {
+        newline[-1] = '\0';
+      }
+      running = HandleProtocolLine(&session, &input[start]);
+      start = (size_t)(newline - input) + 1;
+    }
+    memmove(input, &input[start], length - start);
+    length -= start;
+    fflush(stdout);
+  }
+  free(input);
+  Api.destroy_game(session.game);
+}
+
+// Returns the text after `"key":` in a line of the event log, or NULL if it
+// has no such key.
+static const char* FindEventValue(const char* line, const char* key) {
+  char pattern[32];
+  snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+  const char* value = strstr(line, pattern);
+  return value == NULL ? NULL : value + strlen(pattern);
+}
+
+static int GetEventInt(const char* line, const char* key) {
+  const char* value = FindEventValue(line, key);
+  return value == NULL ? -1 : atoi(value);
+}
+
+static bool EventIs(const char* event, const char* name) {
+  const size_t length = strlen(name);
+  return strncmp(event, name, length) == 0 && event[length] == '"';
+}
+
+// With --replay, plays back a game recorded with --event-log, with no
+// terminal, and checks the game's hash after every event against the one
+// recorded. Since the hash changes with every move and tick, the first event
+// whose hash differs is where the replay and the original diverged. A log
+// from --serve, which interleaves many games, cannot be replayed.
+noreturn void RunReplay(const char* path) {
+  FILE* file = fopen(path, "r");
+  if (file == NULL) {
+    perror(path);
+    exit(EXIT_FAILURE);
+  }
+  Game game = {0};
+  bool started = false;
+  size_t line_number = 0;
+  char line[512];
+  while (fgets(line, sizeof(line), file) != NULL) {
+    ++line_number;
+    const char* event = FindEventValue(line, "event");
+    const char* hash = FindEventValue(line, "hash");
+    unsigned long long expected;
+    if (event == NULL || *event++ != '"' || hash == NULL ||
+        sscanf(hash, "\"%llx\"", &expected) != 1) {
+      fprintf(stderr, "%s:%zu: Not an event\n", path, line_number);
+      exit(EXIT_FAILURE);
+    }
+    const int x = GetEventInt(line, "x");
+    const int y = GetEventInt(line, "y");
+    const int width = GetEventInt(line, "width");
+    const int height = GetEventInt(line, "height");
+    bool happened = true;
+    if (EventIs(event, "start")) {
+      const size_t item_count = Bogus + (size_t)GetEventInt(line, "items");
+      if (!started || width != game.width || height != game.height) {
+        DestroyGame(&game);
+        happened = CreateGame(&game, width, height, item_count - Bogus);
+      } else {
+        happened = ReserveItems(&game, item_count);
+        game.item_count = item_count;
+      }
+      if (happened) {
+        game.items_wander = GetEventInt(line, "wander") == 1;
+        game.kitten_evades = GetEventInt(line, "hard") == 1;
+        const int spacing = GetEventInt(line, "spacing");
+        game.sampler.spacing = spacing > 0 ? spacing : 0;
+        const char* seed = FindEventValue(line, "seed");
+        ResetGame(&game, strtoull(seed != NULL ? seed : "", NULL, 10));
+      }
+      started = happened;
+    } else if (!started) {
+      fprintf(stderr, "%s:%zu: No game has started\n", path, line_number);
+      exit(EXIT_FAILURE);
+    } else if (EventIs(event, "move") || EventIs(event, "touch") ||
+               EventIs(event, "win")) {
+      size_t item_number = 0;
+      const TouchTestResult result = MoveRobot(&game, y, x, &item_number, NULL);
+      happened = EventIs(event, "move")
+                     ? result == TouchTestResultNone
+                 : EventIs(event, "win")
+                     ? result == TouchTestResultKitten
+                     : result == TouchTestResultNonKitten &&
+                           (int)item_number == GetEventInt(line, "item");
+    } else if (EventIs(event, "tick")) {
+      TickGame(&game);
+    } else if (EventIs(event, "resize")) {
+      happened = (width == game.width && height == game.height) ||
+                 ResizeField(&game, width, height);
+    }
+    if (!happened || game.hash != expected) {
+      printf("%s:%zu: Desync: the hash is %016llx, not %016llx\n", path,
+             line_number, (unsigned long long)game.hash, expected);
+      if (EventIs(event, "start")) {
+        // Icon widths, and thus placement, depend on the locale.
+        printf("The game was restored, or played in another locale.\n");
+      }
+      exit(EXIT_FAILURE);
+    }
+  }
+  printf("%s: Replayed %zu events, and every hash matched.\n", path,
+         line_number);
+  exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,27 @@
+// Modes that play without a terminal: --benchmark, --find-seeds,
+// --protocol and --replay.
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+
+#ifndef TOOLS_H
+#define TOOLS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdnoreturn.h>
+
+#include "autopilot.h"
+
+bool RunBenchmark(const Strategy* only, int width, int height,
+                  size_t non_kitten_count, int spacing, uint64_t first_seed,
+                  uint64_t seed_count);
+void RunSeedSearch(int width, int height, size_t non_kitten_count, int spacing,
+                   uint64_t first_seed, uint64_t seed_count,
+                   const char* metric_list, size_t top_count);
+void RunProtocol(int width, int height, size_t non_kitten_count, uint64_t seed);
+noreturn void RunReplay(const char* path);
+
+#endif  // TOOLS_H
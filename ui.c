@@ -0,0 +1,1647 @@
+// This program is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+
+#define _DARWIN_C_SOURCE
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 700
+#define _XOPEN_SOURCE_EXTENDED
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdnoreturn.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "autopilot.h"
+#include "game.h"
+#include "path.h"
+#include "stats.h"
+#include "ui.h"
+
+static const char Introduction[] =
+    "This is robotfindskitten, version 2.718281828, by the illustrious\n"
+    "Leonard Richardson © 1997, 2000.\n"
+    "\n"
+    "Written originally for the Nerth Pork robotfindskitten contest.\n"
+    "\n"
+    "In this game, you are Robot 🤖. Your job is to find Kitten 😺.\n"
+    "Inevitably, this task is complicated by the existence of various\n"
+    "items which are not Kitten. As in our world, things are rarely what\n"
+    "they seem, so you must touch them to determine whether they are\n"
+    "Kitten or not.\n"
+    "\n"
+    "The game ends when robotfindskitten. Alternatively, you may end\n"
+    "the game by pressing the Q key or a good old-fashioned Control-C.\n"
+    "\n"
+    "You can move using the arrow keys, the Emacs movement control sequences,\n"
+    "the vi and NetHack movement keys, or the number keypad, or by clicking\n"
+    "where Robot should go. Press W to find out whether you are getting\n"
+    "warmer, P to ping with sonar for the items around Robot (Shift-P for\n"
+    "each quadrant), M for a map of the whole field, and R to start over\n"
+    "on a new field.\n"
+    "\n"
+    "Press any key to start.\n";
+static const char WinMessage[] = "You found Kitten! Way to go, Robot!";
+static const char PlayAgainMessage[] =
+    "You found Kitten! Press R to play again, or Q to quit.";
+
+static const unsigned int White = 7;
+
+Ui g_ui = {
+    .message = "",
+    .last_hint = Infinity,
+    .autopilot = {.timer = {.interval = 100 * 1000 * 1000}},
+    .walk = {.timer = {.interval = 30 * 1000 * 1000}},
+};
+
+// With --size, the field keeps the given size; otherwise it follows the size
+// of the terminal.
+bool g_fixed_size;
+
+noreturn void Finish(int signal) {
+  endwin();
+  exit(signal);
+}
+
+// SIGINT, SIGTERM, and SIGHUP end the game, but not from the signal handler,
+// which may have interrupted malloc or stdio, and exit would run the atexit
+// hooks there. The handler only notes the signal, and the main loop calls
+// HandleSignals after each wait.
+static volatile sig_atomic_t g_finish_signal;
+
+static void HandleFinishSignal(int signal) {
+  g_finish_signal = signal;
+}
+
+void CatchFinishSignals(void) {
+  CatchSignal(SIGINT, HandleFinishSignal);
+  CatchSignal(SIGTERM, HandleFinishSignal);
+  CatchSignal(SIGHUP, HandleFinishSignal);
+}
+
+// Acts on the signals that have come in since the last call.
+void HandleSignals(void) {
+  if (g_stats_requested) {
+    g_stats_requested = false;
+    WriteStats();
+  }
+  if (g_finish_signal != 0) {
+    Finish(g_finish_signal);
+  }
+}
+
+// With --serve, there is a game per session, and a game ending must end only
+// its session; see RunServer.
+bool g_serving;
+
+// Ends the game: the whole program, or with --serve, just the current
+// session, in which case it returns.
+static void EndGame(Ui* ui, int status) {
+  if (!g_serving) {
+    Finish(status);
+  }
+  ui->game_over = true;
+}
+
+// Sets up the current curses screen.
+void ConfigureScreen(Ui* ui) {
+  nonl();
+  noecho();
+  cbreak();
+  intrflush(stdscr, false);
+  keypad(stdscr, true);
+  start_color();
+  if (has_colors() && (COLOR_PAIRS > 7)) {
+    init_pair(1, COLOR_GREEN, COLOR_BLACK);
+    init_pair(2, COLOR_RED, COLOR_BLACK);
+    init_pair(3, COLOR_YELLOW, COLOR_BLACK);
+    init_pair(4, COLOR_BLUE, COLOR_BLACK);
+    init_pair(5, COLOR_MAGENTA, COLOR_BLACK);
+    init_pair(6, COLOR_CYAN, COLOR_BLACK);
+    init_pair(7, COLOR_WHITE, COLOR_BLACK);
+    bkgd((chtype)COLOR_PAIR(White));
+  }
+  ui->has_colors = has_colors();
+}
+
+void InitializeScreen(Ui* ui) {
+  initscr();
+  ConfigureScreen(ui);
+}
+
+// Returns true if all `width` cells from (y, x) are in view.
+static bool IsInView(const Ui* ui, int y, int x, int width) {
+  const View* view = &ui->view;
+  return y >= view->y && y < view->y + view->height && x >= view->x &&
+         x + width <= view->x + view->width;
+}
+
+// Draws the item into a window whose cell (top, left) shows field cell
+// (0, 0).
+static void DrawItem(WINDOW* window, int top, int left, const Item* item) {
+  const uint64_t start = TraceBegin();
+  mvwaddstr(window, top + item->y, left + item->x, GetIcon(item));
+  TraceEnd(TracePhaseDrawItem, start);
+}
+
+static void MarkDirty(Ui* ui, int y, int x, int width) {
+  if (ui->dirty.span_count == COUNT(ui->dirty.spans)) {
+    ui->dirty.frame = true;
+    return;
+  }
+  ui->dirty.spans[ui->dirty.span_count++] =
+      (DirtySpan){.y = y, .x = x, .width = width};
+}
+
+static struct {
+  const char* name;
+  Broadcast* broadcast;
+} g_publish;
+
+static void StopPublishing(void) {
+  shm_unlink(g_publish.name);
+}
+
+// Creates the shared memory object `name` for a game of up to `item_capacity`
+// items. Returns false if it cannot.
+bool StartPublishing(const char* name, size_t item_capacity) {
+  const size_t size = sizeof(Broadcast) + item_capacity * sizeof(Item);
+  // Spectators of an earlier game keep that game's object to themselves.
+  shm_unlink(name);
+  const int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+  if (fd < 0) {
+    return false;
+  }
+  Broadcast* broadcast = ftruncate(fd, (off_t)size) != 0
+                             ? MAP_FAILED
+                             : mmap(NULL, size, PROT_READ | PROT_WRITE,
+                                    MAP_SHARED, fd, 0);
+  close(fd);
+  if (broadcast == MAP_FAILED) {
+    shm_unlink(name);
+    return false;
+  }
+  broadcast->item_capacity = item_capacity;
+  broadcast->version = BroadcastVersion;
+  broadcast->magic = BroadcastMagic;
+  g_publish.name = name;
+  g_publish.broadcast = broadcast;
+  atexit(StopPublishing);
+  return true;
+}
+
+static void PublishGame(Ui* ui) {
+  Broadcast* broadcast = g_publish.broadcast;
+  const uint64_t sequence =
+      atomic_load_explicit(&broadcast->sequence, memory_order_relaxed);
+  atomic_store_explicit(&broadcast->sequence, sequence + 1,
+                        memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  broadcast->width = ui->game.width;
+  broadcast->height = ui->game.height;
+  broadcast->border_color = ui->game.border_color;
+  broadcast->fog_radius = ui->game.sight.radius;
+  broadcast->item_count = ui->game.item_count;
+  snprintf(broadcast->message, sizeof(broadcast->message), "%s", ui->message);
+  memcpy(broadcast->items, ui->game.items, ui->game.item_count * sizeof(Item));
+  atomic_store_explicit(&broadcast->sequence, sequence + 2,
+                        memory_order_release);
+}
+
+static void Paint(Ui* ui) {
+  const uint64_t start = TraceBegin();
+  refresh();
+  TraceEnd(TracePhaseRefresh, start);
+  if (g_publish.broadcast != NULL) {
+    PublishGame(ui);
+  }
+  CountEvent(&g_stats.paints);
+}
+
+// Returns the frame character at (y, x), or NULL if the frame isn't there.
+static const cchar_t* GetFrameCharacter(const Game* game, int y, int x) {
+  const bool top = y == 0;
+  const bool bottom = y == game->height - 1;
+  const bool left = x == 0;
+  const bool right = x == game->width - 1;
+  if (top || bottom) {
+    if (left) {
+      return top ? WACS_ULCORNER : WACS_LLCORNER;
+    }
+    if (right) {
+      return top ? WACS_URCORNER : WACS_LRCORNER;
+    }
+    return WACS_HLINE;
+  }
+  return left || right ? WACS_VLINE : NULL;
+}
+
+// Loops over the field cells in the UI's view.
+#define FOR_EACH_CELL_IN_VIEW(ui, y, x)                                      \
+  for (int y = (ui)->view.y;                                                 \
+       y < (ui)->view.y + (ui)->view.height && y < (ui)->game.height; ++y)   \
+    for (int x = (ui)->view.x;                                               \
+         x < (ui)->view.x + (ui)->view.width && x < (ui)->game.width; ++x)
+
+static void DrawFrame(Ui* ui, WINDOW* window) {
+  const unsigned int attributes = COLOR_PAIR(ui->game.border_color) | A_BOLD;
+  if (ui->has_colors) {
+    wattron(window, attributes);
+  }
+  FOR_EACH_CELL_IN_VIEW(ui, y, x) {
+    const cchar_t* c = GetFrameCharacter(&ui->game, y, x);
+    if (c != NULL) {
+      mvwadd_wch(window, y - ui->view.y, x - ui->view.x, c);
+    }
+  }
+  if (ui->has_colors) {
+    wattroff(window, attributes);
+  }
+}
+
+// Draws the items in view, other than Robot. An item only partly in view, or
+// hidden by the fog, is left out.
+static void DrawItems(Ui* ui, WINDOW* window) {
+  FOR_EACH_CELL_IN_VIEW(ui, y, x) {
+    const uint32_t occupant = GetOccupant(&ui->game, y, x);
+    if (occupant == 0 || occupant - 1 == Robot) {
+      continue;
+    }
+    const Item* item = &ui->game.items[occupant - 1];
+    if (item->x == x && IsInView(ui, y, x, GetItemWidth(item)) &&
+        ItemIsSeen(&ui->game, item)) {
+      DrawItem(window, -ui->view.y, -ui->view.x, item);
+    }
+  }
+}
+
+// Redraws the layers with whatever is in view.
+void DrawLayers(Ui* ui) {
+  werase(ui->frame_layer);
+  werase(ui->item_layer);
+  DrawFrame(ui, ui->frame_layer);
+  DrawItems(ui, ui->item_layer);
+  ui->game.sight.change_count = 0;
+}
+
+static WINDOW* NewLayer(Ui* ui) {
+  WINDOW* layer = newpad(ui->view.height, ui->view.width);
+  if (layer == NULL) {
+    endwin();
+    fprintf(stderr, "Could not allocate the screen layers!\n");
+    exit(EXIT_FAILURE);
+  }
+  if (ui->has_colors) {
+    wbkgd(layer, (chtype)COLOR_PAIR(White));
+  }
+  return layer;
+}
+
+// Returns the offset of a view `view_size` cells long onto a field
+// `field_size` cells long, such that the `size` cells from `position` are
+// well inside it. The view moves only when they get near its edge, and then
+// by half its length, so that it scrolls rarely.
+static int ScrollView(int offset, int view_size, int field_size, int position,
+                      int size) {
+  if (field_size <= view_size) {
+    return 0;
+  }
+  const int margin = view_size / 4;
+  if (position < offset + margin ||
+      position + size > offset + view_size - margin) {
+    offset = position + size / 2 - view_size / 2;
+  }
+  if (offset > field_size - view_size) {
+    offset = field_size - view_size;
+  }
+  return offset < 0 ? 0 : offset;
+}
+
+// Scrolls the view, if need be, to keep Robot well inside it. Returns true if
+// the view moved.
+bool FollowRobot(Ui* ui) {
+  const Item* robot = &ui->game.items[Robot];
+  const int y =
+      ScrollView(ui->view.y, ui->view.height, ui->game.height, robot->y, 1);
+  const int x = ScrollView(ui->view.x, ui->view.width, ui->game.width, robot->x,
+                           GetItemWidth(robot));
+  if (y == ui->view.y && x == ui->view.x) {
+    return false;
+  }
+  ui->view.y = y;
+  ui->view.x = x;
+  return true;
+}
+
+// Braille dot (row, column) of a character is this bit of its code point
+// past U+2800.
+static const uint8_t BrailleDots[4][2] = {
+    {0x01, 0x08}, {0x02, 0x10}, {0x04, 0x20}, {0x40, 0x80}};
+
+void FreeMinimap(Minimap* minimap) {
+  free(minimap->untouched);
+  free(minimap->visits);
+  free(minimap->changes);
+  free(minimap->changed);
+  minimap->untouched = minimap->visits = minimap->changes = NULL;
+  minimap->changed = NULL;
+  minimap->change_count = 0;
+}
+
+// Returns the row of dots that field row y is in.
+static int GetMinimapRow(const Minimap* minimap, int y) {
+  return (y >> BlockShift) / minimap->scale;
+}
+
+// Returns the column of dots that field column x is in.
+static int GetMinimapColumn(const Minimap* minimap, int x) {
+  return (x >> BlockShift) / (2 * minimap->scale);
+}
+
+static size_t GetMinimapDot(const Minimap* minimap, int row, int column) {
+  return (size_t)row * (size_t)minimap->columns * 2 + (size_t)column;
+}
+
+// Works out the minimap's scale and size for the field and the screen, and
+// sums the block summaries into its dots. The buffers are kept if the size
+// is the same, as it is for each new round. The minimap is hidden if the
+// screen has no room for it.
+static void LayoutMinimap(Ui* ui) {
+  Minimap* minimap = &ui->minimap;
+  const Game* game = &ui->game;
+  const int most_columns = COLS / 4;
+  const int most_rows = LINES - HeaderSize;
+  if (!minimap->shown || most_columns < 1 || most_rows < 1) {
+    FreeMinimap(minimap);
+    minimap->shown = false;
+    return;
+  }
+  const int old_rows = minimap->rows;
+  const int old_columns = minimap->columns;
+  // A character covers 4 * scale blocks each way.
+  const int across = (game->block_columns + 4 * most_columns - 1) /
+                     (4 * most_columns);
+  const int down =
+      (game->block_rows + 4 * most_rows - 1) / (4 * most_rows);
+  const int scale = across > down ? across : down;
+  minimap->scale = scale > 1 ? scale : 1;
+  const int span = 4 * minimap->scale;
+  minimap->columns = (game->block_columns + span - 1) / span;
+  minimap->rows = (game->block_rows + span - 1) / span;
+  minimap->left = COLS - minimap->columns;
+  minimap->braille = wcwidth(0x2800) == 1;
+
+  const size_t characters =
+      (size_t)minimap->rows * (size_t)minimap->columns;
+  if (minimap->untouched != NULL && minimap->rows == old_rows &&
+      minimap->columns == old_columns) {
+    memset(minimap->untouched, 0, characters * 8 * sizeof(uint32_t));
+    memset(minimap->visits, 0, characters * 8 * sizeof(uint32_t));
+    memset(minimap->changed, 0, characters * sizeof(bool));
+    minimap->change_count = 0;
+  } else {
+    FreeMinimap(minimap);
+    minimap->untouched = calloc(characters * 8, sizeof(uint32_t));
+    minimap->visits = calloc(characters * 8, sizeof(uint32_t));
+    minimap->changes = malloc(characters * sizeof(uint32_t));
+    minimap->changed = calloc(characters, sizeof(bool));
+    if (minimap->untouched == NULL || minimap->visits == NULL ||
+        minimap->changes == NULL || minimap->changed == NULL) {
+      FreeMinimap(minimap);
+      minimap->shown = false;
+      return;
+    }
+  }
+  for (int y = 0; y < game->block_rows; ++y) {
+    for (int x = 0; x < game->block_columns; ++x) {
+      const size_t block =
+          (size_t)y * (size_t)game->block_columns + (size_t)x;
+      const size_t dot =
+          GetMinimapDot(minimap, GetMinimapRow(minimap, y << BlockShift),
+                        GetMinimapColumn(minimap, x << BlockShift));
+      minimap->untouched[dot] +=
+          game->block_items[block] - game->block_touched[block];
+      minimap->visits[dot] += game->block_visits[block];
+    }
+  }
+}
+
+// Adds to the sums of the dot that field cell (y, x) is in, and marks its
+// character to be redrawn.
+static void CountInMinimap(Minimap* minimap, int y, int x, int untouched,
+                           int visits) {
+  if (!minimap->shown) {
+    return;
+  }
+  const int row = GetMinimapRow(minimap, y);
+  const int column = GetMinimapColumn(minimap, x);
+  const size_t dot = GetMinimapDot(minimap, row, column);
+  minimap->untouched[dot] += (uint32_t)untouched;
+  minimap->visits[dot] += (uint32_t)visits;
+  const size_t character =
+      (size_t)(row / 4) * (size_t)minimap->columns + (size_t)(column / 2);
+  if (!minimap->changed[character]) {
+    minimap->changed[character] = true;
+    minimap->changes[minimap->change_count++] = (uint32_t)character;
+  }
+}
+
+static void DrawMinimapCharacter(Ui* ui, size_t character) {
+  Minimap* minimap = &ui->minimap;
+  const Game* game = &ui->game;
+  const int row = (int)(character / (size_t)minimap->columns);
+  const int column = (int)(character % (size_t)minimap->columns);
+  const bool fog = game->sight.radius > 0;
+  unsigned int dots = 0;
+  int raised = 0;
+  bool visited = false;
+  for (int y = 0; y < 4; ++y) {
+    for (int x = 0; x < 2; ++x) {
+      const size_t dot =
+          GetMinimapDot(minimap, 4 * row + y, 2 * column + x);
+      if ((fog ? minimap->visits[dot] : minimap->untouched[dot]) > 0) {
+        dots |= BrailleDots[y][x];
+        ++raised;
+      }
+      visited = visited || minimap->visits[dot] > 0;
+    }
+  }
+  char text[4] = {" ...:::##"[raised]};
+  if (minimap->braille) {
+    // U+2800 + dots, in UTF-8.
+    text[0] = (char)0xe2;
+    text[1] = (char)(0xa0 | dots >> 6);
+    text[2] = (char)(0x80 | (dots & 0x3f));
+  }
+  const Item* robot = &game->items[Robot];
+  const bool has_robot = GetMinimapRow(minimap, robot->y) / 4 == row &&
+                         GetMinimapColumn(minimap, robot->x) / 2 == column;
+  const attr_t attributes =
+      (visited ? A_NORMAL : A_BOLD) | (has_robot ? A_REVERSE : A_NORMAL);
+  const int y = HeaderSize + row;
+  const int x = minimap->left + column;
+  mvaddstr(y, x, text);
+  mvchgat(y, x, 1, attributes, ui->has_colors ? (short)White : 0, NULL);
+}
+
+static void ClearMinimapChanges(Minimap* minimap) {
+  for (size_t i = 0; i < minimap->change_count; ++i) {
+    minimap->changed[minimap->changes[i]] = false;
+  }
+  minimap->change_count = 0;
+}
+
+// Draws the whole minimap, and the line between it and the view.
+static void DrawMinimap(Ui* ui) {
+  Minimap* minimap = &ui->minimap;
+  if (!minimap->shown) {
+    return;
+  }
+  mvvline(HeaderSize, minimap->left - 1, ACS_VLINE, LINES - HeaderSize);
+  const size_t characters =
+      (size_t)minimap->rows * (size_t)minimap->columns;
+  for (size_t i = 0; i < characters; ++i) {
+    DrawMinimapCharacter(ui, i);
+  }
+  ClearMinimapChanges(minimap);
+}
+
+// Redraws the characters of the minimap that changed since it was last
+// drawn.
+static void DrawMinimapChanges(Ui* ui) {
+  Minimap* minimap = &ui->minimap;
+  for (size_t i = 0; i < minimap->change_count; ++i) {
+    DrawMinimapCharacter(ui, minimap->changes[i]);
+  }
+  ClearMinimapChanges(minimap);
+}
+
+// (Re)builds the static layers at the current screen size.
+void BuildLayers(Ui* ui) {
+  if (ui->frame_layer != NULL) {
+    delwin(ui->frame_layer);
+  }
+  if (ui->item_layer != NULL) {
+    delwin(ui->item_layer);
+  }
+  LayoutMinimap(ui);
+  ui->view.height = LINES - HeaderSize;
+  ui->view.width = ui->minimap.shown ? ui->minimap.left - 1 : COLS;
+  ui->frame_layer = NewLayer(ui);
+  ui->item_layer = NewLayer(ui);
+  FollowRobot(ui);
+  DrawLayers(ui);
+}
+
+// Updates the item layer and the minimap for the items that moved in the
+// last tick, and marks the cells they left and entered dirty.
+static void DrawItemMoves(Ui* ui) {
+  for (size_t i = 0; i < ui->game.move_count; ++i) {
+    const ItemMove* move = &ui->game.moves[i];
+    const Item* item = &ui->game.items[move->item];
+    const int width = GetItemWidth(item);
+    const int untouched = !IsTouched(&ui->game, move->item);
+    CountInMinimap(&ui->minimap, move->y, move->x, -untouched, 0);
+    CountInMinimap(&ui->minimap, item->y, item->x, untouched, 0);
+    if (IsInView(ui, move->y, move->x, width)) {
+      mvwprintw(ui->item_layer, move->y - ui->view.y, move->x - ui->view.x,
+                "%*s", width, "");
+      MarkDirty(ui, move->y, move->x, width);
+    }
+    if (IsInView(ui, item->y, item->x, width) && ItemIsSeen(&ui->game, item)) {
+      DrawItem(ui->item_layer, -ui->view.y, -ui->view.x, item);
+      MarkDirty(ui, item->y, item->x, width);
+    }
+  }
+}
+
+// With --fog, updates the item layer for the items on the cells that just
+// came into or went out of Robot's sight.
+static void DrawSightChanges(Ui* ui) {
+  FieldOfView* sight = &ui->game.sight;
+  for (size_t i = 0; i < sight->change_count; ++i) {
+    const uint32_t occupant = ui->game.occupancy[sight->changes[i]];
+    if (occupant == 0 || occupant - 1 == Robot) {
+      continue;
+    }
+    const Item* item = &ui->game.items[occupant - 1];
+    const int width = GetItemWidth(item);
+    if (!IsInView(ui, item->y, item->x, width)) {
+      continue;
+    }
+    if (ItemIsSeen(&ui->game, item)) {
+      DrawItem(ui->item_layer, -ui->view.y, -ui->view.x, item);
+    } else {
+      mvwprintw(ui->item_layer, item->y - ui->view.y, item->x - ui->view.x,
+                "%*s", width, "");
+    }
+    MarkDirty(ui, item->y, item->x, width);
+  }
+  sight->change_count = 0;
+}
+
+// Header messages must be cut to the screen width in columns, not bytes:
+// messages are UTF-8, and many characters are more than 1 byte (and some are
+// more than 1 column). Measuring a message means decoding all of it, so we
+// remember how many bytes of each message fit at the current screen width.
+// The cache is keyed by the message's text, not its address, since some
+// messages are formatted into buffers that are reused. It is direct-mapped
+// on a hash of the text, and keeps a copy of the text, since 2 messages with
+// the same hash must not share a cut. A message too long to copy is
+// measured every time; no built-in message is that long.
+typedef struct MessageLayout {
+  char text[128];
+  int columns;
+  int bytes;
+} MessageLayout;
+
+static MessageLayout g_message_layouts[256];
+
+// Returns a hash of the message's text (FNV-1a), and sets *length to its
+// length. This is much cheaper than decoding it.
+static uint64_t HashMessage(const char* message, size_t* length) {
+  uint64_t hash = 0xcbf29ce484222325;
+  size_t i = 0;
+  for (; message[i] != '\0'; ++i) {
+    hash = (hash ^ (unsigned char)message[i]) * 0x100000001b3;
+  }
+  *length = i;
+  return hash;
+}
+
+// Returns the number of bytes of `message` that fit in `columns` columns,
+// without splitting a character.
+static int MeasureMessage(const char* message, int columns) {
+  mbstate_t state;
+  memset(&state, 0, sizeof(state));
+  const size_t length = strlen(message);
+  size_t bytes = 0;
+  int used = 0;
+  while (bytes < length) {
+    wchar_t c;
+    const size_t n = mbrtowc(&c, &message[bytes], length - bytes, &state);
+    if (n == (size_t)-1 || n == (size_t)-2 || n == 0) {
+      break;
+    }
+    const int width = wcwidth(c);
+    const int cell_width = width < 0 ? 1 : width;
+    if (used + cell_width > columns) {
+      break;
+    }
+    used += cell_width;
+    bytes += n;
+  }
+  return (int)bytes;
+}
+
+static int GetMessageLayout(const char* message) {
+  size_t length;
+  const uint64_t hash = HashMessage(message, &length);
+  if (length >= sizeof(g_message_layouts[0].text)) {
+    return MeasureMessage(message, COLS);
+  }
+  MessageLayout* layout =
+      &g_message_layouts[hash % COUNT(g_message_layouts)];
+  if (layout->columns != COLS || strcmp(layout->text, message) != 0) {
+    memcpy(layout->text, message, length + 1);
+    layout->columns = COLS;
+    layout->bytes = MeasureMessage(message, COLS);
+  }
+  return layout->bytes;
+}
+
+static void DrawHeader(Ui* ui) {
+  if (ui->has_colors) {
+    attrset(COLOR_PAIR(White));
+  }
+  move(0, 0);
+  clrtoeol();
+  mvaddnstr(0, 0, ui->message, GetMessageLayout(ui->message));
+}
+
+// Copies the part of a rectangle of the field that is in view from the
+// layers onto stdscr.
+static void ComposeRegion(Ui* ui, int y, int x, int rows, int columns) {
+  const int top = (y > ui->view.y ? y : ui->view.y) - ui->view.y;
+  const int left = (x > ui->view.x ? x : ui->view.x) - ui->view.x;
+  const int bottom = (y + rows < ui->view.y + ui->view.height
+                          ? y + rows
+                          : ui->view.y + ui->view.height) -
+                     ui->view.y - 1;
+  const int right =
+      (x + columns < ui->view.x + ui->view.width ? x + columns
+                                             : ui->view.x + ui->view.width) -
+      ui->view.x - 1;
+  if (top > bottom || left > right) {
+    return;
+  }
+  copywin(ui->frame_layer, stdscr, top, left, HeaderSize + top, left,
+          HeaderSize + bottom, right, false);
+  copywin(ui->item_layer, stdscr, top, left, HeaderSize + top, left,
+          HeaderSize + bottom, right, true);
+}
+
+static void MoveCursorToRobot(Ui* ui) {
+  const Item* robot = &ui->game.items[Robot];
+  move(HeaderSize + robot->y - ui->view.y, robot->x - ui->view.x);
+}
+
+// Draws the dynamic layer over the composited layers and refreshes.
+static void FinishFrame(Ui* ui) {
+  DrawHeader(ui);
+  DrawItem(stdscr, HeaderSize - ui->view.y, -ui->view.x,
+           &ui->game.items[Robot]);
+  DrawMinimapChanges(ui);
+  MoveCursorToRobot(ui);
+  Paint(ui);
+}
+
+// Composites the whole screen from the layers and refreshes.
+static void ComposeFrame(Ui* ui) {
+  // The field may not cover the whole screen.
+  erase();
+  ComposeRegion(ui, ui->view.y, ui->view.x, ui->view.height, ui->view.width);
+  DrawMinimap(ui);
+  FinishFrame(ui);
+}
+
+// Composites only the dirty spans, such as the cells Robot just left, and
+// refreshes.
+static void ComposeDirtySpans(Ui* ui) {
+  for (size_t i = 0; i < ui->dirty.span_count; ++i) {
+    const DirtySpan* span = &ui->dirty.spans[i];
+    ComposeRegion(ui, span->y, span->x, 1, span->width);
+  }
+  FinishFrame(ui);
+}
+
+static void DrawMessage(Ui* ui, const char* message) {
+  const uint64_t start = TraceBegin();
+  ui->message = message;
+  DrawHeader(ui);
+  DrawMinimapChanges(ui);
+  MoveCursorToRobot(ui);
+  Paint(ui);
+  TraceEnd(TracePhaseDrawMessage, start);
+}
+
+void RedrawScreen(Ui* ui) {
+  const uint64_t start = TraceBegin();
+  // Repaint the whole terminal, not just the cells curses thinks changed.
+  clearok(curscr, true);
+  ComposeFrame(ui);
+  CountEvent(&g_stats.full_redraws);
+  TraceEnd(TracePhaseRedrawScreen, start);
+}
+
+void HandleResize(Ui* ui) {
+  const uint64_t start = TraceBegin();
+  // Has the resize hidden any items? (A field of fixed size just scrolls.)
+  if (!g_fixed_size && !ResizeField(&ui->game, COLS, LINES - HeaderSize)) {
+    if (g_serving) {
+      EndGame(ui, EXIT_FAILURE);
+      return;
+    }
+    endwin();
+    fprintf(stderr, "You crushed the simulation. And robot. And kitten.\n");
+    exit(EXIT_FAILURE);
+  }
+
+  BuildLayers(ui);
+  ui->dirty.full = true;
+  LogEvent((Event){.type = EventTypeResize,
+                   .x = COLS,
+                   .y = LINES,
+                   .width = ui->game.width,
+                   .height = ui->game.height,
+                   .hash = ui->game.hash});
+  TraceEnd(TracePhaseHandleResize, start);
+}
+
+void ShowIntroduction(Ui* ui) {
+  clear();
+  move(0, 0);
+  printw(Introduction);
+  refresh();
+  if (getch() == KEY_RESIZE) {
+    HandleResize(ui);
+  }
+  clear();
+}
+
+static void PlayAnimation(Ui* ui, bool approach_from_right) {
+  move(0, 0);
+  clrtoeol();
+  const int animation_meet = (COLS / 2);
+
+  static const char KittenIcon[] = "😺";
+  const int robot_width = GetItemWidth(&ui->game.items[Robot]);
+  const int kitten_width = GetDisplayWidth(KittenIcon);
+
+  for (int i = 4; i > 0; --i) {
+    const uint64_t start = TraceBegin();
+    printf("\a");
+
+    int robot_x;
+    int kitten_x;
+    if (approach_from_right) {
+      robot_x = animation_meet + i;
+      kitten_x = animation_meet - i + 1 - (kitten_width - 1);
+    } else {
+      robot_x = animation_meet - i + 1 - (robot_width - 1);
+      kitten_x = animation_meet + i;
+    }
+
+    move(0, 0);
+    clrtoeol();
+    mvaddstr(0, robot_x, RobotIcon);
+    mvaddstr(0, kitten_x, KittenIcon);
+    move(0, robot_x);
+    Paint(ui);
+    TraceEnd(TracePhaseAnimationFrame, start);
+    sleep(1);
+  }
+  DrawMessage(ui, WinMessage);
+  curs_set(0);
+  sleep(1);
+}
+
+// Returns the number of milliseconds until the timer is due, or `timeout` if
+// that is sooner. A negative timeout means forever.
+int GetTimerTimeout(const Timer* timer, int timeout) {
+  if (!timer->enabled) {
+    return timeout;
+  }
+  const uint64_t now = Now();
+  const int due = now >= timer->next
+                      ? 0
+                      : (int)((timer->next - now + 999999) / 1000000);
+  return timeout < 0 || due < timeout ? due : timeout;
+}
+
+// Returns true, and schedules the next time, if the timer is due. A timer
+// that has fallen more than an interval behind skips ahead rather than
+// firing in a burst.
+static bool TimerIsDue(Timer* timer) {
+  const uint64_t now = Now();
+  if (!timer->enabled || now < timer->next) {
+    return false;
+  }
+  timer->next = now - timer->next < timer->interval
+                    ? timer->next + timer->interval
+                    : now + timer->interval;
+  return true;
+}
+
+static void ShowMessage(Ui* ui, const char* message) {
+  ui->message = message;
+  ui->dirty.header = true;
+}
+
+// Hints, by how many steps Robot is from Kitten, and whether that is fewer
+// (warmer) or more (colder) than at the last hint.
+static const struct {
+  uint32_t distance;
+  const char* messages[3];
+} Hints[] = {
+    {2, {"Robot is burning hot!", "Warmer! Robot is burning hot!",
+         "Colder, but Robot is still burning hot!"}},
+    {5, {"Robot is hot.", "Warmer! Robot is hot.", "Colder. Robot is hot."}},
+    {10, {"Robot is warm.", "Warmer! Robot is warm.",
+          "Colder. Robot is warm."}},
+    {20, {"Robot is cool.", "Warmer. Robot is cool.",
+          "Colder. Robot is cool."}},
+    {40, {"Robot is cold.", "Warmer. Robot is cold.",
+          "Colder. Robot is cold."}},
+    {Infinity - 1, {"Robot is freezing.", "Warmer. Robot is freezing.",
+                    "Colder. Robot is freezing."}},
+    {Infinity, {"Robot cannot get to Kitten from here.",
+                "Robot cannot get to Kitten from here.",
+                "Robot cannot get to Kitten from here."}},
+};
+
+// With --save, the S key saves the game there, to be resumed with --restore.
+const char* g_save_path;
+
+static void SaveSnapshot(Ui* ui) {
+  if (g_save_path == NULL) {
+    ShowMessage(ui, "Start with --save to save the game.");
+  } else if (SaveGame(&ui->game, g_save_path)) {
+    ShowMessage(ui, "Saved the game.");
+  } else {
+    ShowMessage(ui, "Could not save the game!");
+  }
+}
+
+// The P key pings with sonar, which tells how many items are within
+// g_sonar_radius of Robot, and Shift-P how many in each quadrant around it.
+// An item on a line between quadrants is in the one clockwise of the line.
+int g_sonar_radius = 20;
+
+static void PingSonar(Ui* ui, bool by_quadrant) {
+  const Item* robot = &ui->game.items[Robot];
+  const int y = robot->y;
+  const int x = robot->x;
+  const int width = ui->game.width;
+  const int height = ui->game.height;
+  if (by_quadrant) {
+    const Box quadrants[] = {
+        {.top = 0, .left = x, .bottom = y, .right = width},
+        {.top = y, .left = x + 1, .bottom = height, .right = width},
+        {.top = y + 1, .left = 0, .bottom = height, .right = x + 1},
+        {.top = 0, .left = 0, .bottom = y + 1, .right = x},
+    };
+    unsigned long long counts[COUNT(quadrants)];
+    unsigned long long count = 0;
+    for (size_t i = 0; i < COUNT(quadrants); ++i) {
+      counts[i] = CountItemsNear(&ui->game, y, x, g_sonar_radius, quadrants[i]);
+      count += counts[i];
+    }
+    snprintf(ui->sonar_message, sizeof(ui->sonar_message),
+             "Sonar: %llu %s in range %d (%llu NE, %llu SE, %llu SW, "
+             "%llu NW).",
+             count, count == 1 ? "item" : "items", g_sonar_radius, counts[0],
+             counts[1], counts[2], counts[3]);
+  } else {
+    const unsigned long long count = CountItemsNear(
+        &ui->game, y, x, g_sonar_radius,
+        (Box){.top = 0, .left = 0, .bottom = height, .right = width});
+    snprintf(ui->sonar_message, sizeof(ui->sonar_message),
+             "Sonar: %llu %s in range %d.", count,
+             count == 1 ? "item" : "items", g_sonar_radius);
+  }
+  ShowMessage(ui, ui->sonar_message);
+}
+
+static void ShowHint(Ui* ui) {
+  const uint32_t distance = GetKittenDistance(&ui->game);
+  // The first hint, or the first since Kitten was out of reach, has nothing
+  // to compare with.
+  const size_t trend = ui->last_hint == Infinity ? 0
+                       : distance < ui->last_hint ? 1
+                       : distance > ui->last_hint ? 2
+                                                : 0;
+  ui->last_hint = distance;
+  size_t i = 0;
+  while (Hints[i].distance < distance) {
+    ++i;
+  }
+  ShowMessage(ui, Hints[i].messages[trend]);
+}
+
+// Paints whatever the keys handled since the last call have changed.
+void Render(Ui* ui) {
+  if (ui->dirty.full) {
+    RedrawScreen(ui);
+  } else if (ui->dirty.frame) {
+    ComposeFrame(ui);
+  } else if (ui->dirty.span_count > 0) {
+    ComposeDirtySpans(ui);
+  } else if (ui->dirty.header || ui->minimap.change_count > 0) {
+    DrawMessage(ui, ui->message);
+  }
+  ui->dirty.full = ui->dirty.frame = ui->dirty.header = false;
+  ui->dirty.span_count = 0;
+
+  const uint64_t paint_time = Now();
+  for (size_t i = 0; i < ui->unpainted_count; ++i) {
+    const UnpaintedKey* key = &ui->unpainted[i];
+    HistogramRecord(&g_stats.update_to_paint, paint_time - key->update_time);
+    HistogramRecord(&g_stats.input_to_paint, paint_time - key->input_time);
+  }
+  ui->unpainted_count = 0;
+}
+
+// With --grow, each round after a win has this many more non-kitten items
+// than the last, for as long as they fit in the room reserved at the start.
+size_t g_growth;
+
+void LogStart(const Game* game) {
+  LogEvent((Event){.type = EventTypeStart,
+                   .seed = game->seed,
+                   .item = game->item_count - Bogus,
+                   .x = COLS,
+                   .y = LINES,
+                   .width = game->width,
+                   .height = game->height,
+                   .items_wander = game->items_wander,
+                   .kitten_evades = game->kitten_evades,
+                   .spacing = game->sampler.spacing,
+                   .hash = game->hash});
+}
+
+// Starts another round on the same screen, in the same buffers, with the
+// next seed after this round's. After a win, there are g_growth more items.
+static void StartRound(Ui* ui, bool won) {
+  size_t count = ui->game.item_count + (won ? g_growth : 0);
+  const size_t room = GetFieldCapacity(ui->game.width, ui->game.height);
+  count = count < ui->game.item_capacity ? count : ui->game.item_capacity;
+  ui->game.item_count = count < room ? count : room;
+  Random seeds = {.state = ui->game.seed};
+  ResetGame(&ui->game, NextRandom(&seeds));
+  ui->round_over = false;
+  ui->walk.timer.enabled = false;
+  ui->last_hint = Infinity;
+  if (ui->autopilot.timer.enabled) {
+    const Strategy* strategy = ui->autopilot.autopilot.strategy;
+    FinishAutopilot(&ui->autopilot.autopilot);
+    ResetAutopilot(&ui->autopilot.autopilot, strategy, &ui->game);
+  }
+  LayoutMinimap(ui);
+  FollowRobot(ui);
+  DrawLayers(ui);
+  ui->message = "";
+  ui->dirty.full = true;
+  curs_set(1);
+  LogStart(&ui->game);
+}
+
+// Tries to move Robot to (y, x), whether for a key or for the autopilot, and
+// shows what happened. `approach_from_right` says which side Robot comes at
+// Kitten from in the ending animation.
+static void HandleMove(Ui* ui, int y, int x, bool approach_from_right) {
+  const Item* robot = &ui->game.items[Robot];
+  const int old_y = robot->y;
+  const int old_x = robot->x;
+  size_t item_number = 0;
+  if (ui->round_over) {
+    if (y != old_y || x != old_x) {
+      ShowMessage(ui, PlayAgainMessage);
+    }
+    return;
+  }
+
+  // Let's see where we've landed.
+  const uint64_t touch_start = TraceBegin();
+  bool first_touch = false;
+  const TouchTestResult touched =
+      MoveRobot(&ui->game, y, x, &item_number, &first_touch);
+  TraceEnd(TracePhaseTouchTest, touch_start);
+  switch (touched) {
+    case TouchTestResultNone:
+      // Robot moved.
+      MarkDirty(ui, old_y, old_x, GetItemWidth(robot));
+      CountInMinimap(&ui->minimap, old_y, old_x, 0, 0);
+      CountInMinimap(&ui->minimap, y, x, 0, 1);
+      DrawSightChanges(ui);
+      if (FollowRobot(ui)) {
+        DrawLayers(ui);
+        ui->dirty.frame = true;
+      }
+      LogEvent((Event){
+          .type = EventTypeMove, .x = x, .y = y, .hash = ui->game.hash});
+      ui->message = "";
+      ui->dirty.header = true;
+      break;
+    case TouchTestResultRobot:
+    case TouchTestResultEdge:
+      // Nothing happened.
+      break;
+    case TouchTestResultKitten:
+      LogEvent((Event){
+          .type = EventTypeWin, .x = x, .y = y, .hash = ui->game.hash});
+      Render(ui);
+      // The animation sleeps, which would hold up every other session.
+      if (!g_serving) {
+        PlayAnimation(ui, approach_from_right);
+      }
+      // Robot on autopilot has nobody to play again.
+      if (ui->autopilot.timer.enabled) {
+        EndGame(ui, EXIT_SUCCESS);
+        return;
+      }
+      ui->round_over = true;
+      ShowMessage(ui, PlayAgainMessage);
+      return;
+    case TouchTestResultNonKitten: {
+      const Item* item = &ui->game.items[item_number];
+      CountInMinimap(&ui->minimap, item->y, item->x, -first_touch, 0);
+      const uint32_t message = item->message;
+      LogEvent((Event){.type = EventTypeTouch,
+                       .x = x,
+                       .y = y,
+                       .item = item_number,
+                       .message = message,
+                       .hash = ui->game.hash});
+      ShowMessage(ui, GetMessage(item));
+      break;
+    }
+  }
+}
+
+// Handles a click at (y, x) on the screen.
+void HandleClick(Ui* ui, int y, int x) {
+  if (y < HeaderSize || y >= HeaderSize + ui->view.height ||
+      x >= ui->view.width) {
+    return;
+  }
+  // Robot's icon may be more than 1 cell wide. Put it over the cell clicked,
+  // but inside the frame.
+  const int width = GetItemWidth(&ui->game.items[Robot]);
+  const int field_y = y - HeaderSize + ui->view.y;
+  int field_x = x + ui->view.x;
+  if (field_x + width > ui->game.width - FrameThickness) {
+    field_x = ui->game.width - FrameThickness - width;
+  }
+  if (!IsInside(&ui->game, field_y, field_x, width)) {
+    return;
+  }
+  if (!FindPath(&ui->game.paths, &ui->game, field_y, field_x)) {
+    ShowMessage(ui, "Robot cannot find a way there.");
+    return;
+  }
+  ui->walk.next = 0;
+  ui->walk.timer.enabled = ui->game.paths.path_length > 0;
+  ui->walk.timer.next = Now();
+}
+
+// Takes Robot's next step towards where it was sent.
+static void StepWalk(Ui* ui) {
+  const PathFinder* finder = &ui->game.paths;
+  const Item* robot = &ui->game.items[Robot];
+  const uint32_t target = finder->path[ui->walk.next];
+  const int target_y = (int)(target / (uint32_t)ui->game.width);
+  const int target_x = (int)(target % (uint32_t)ui->game.width);
+  const int dy = Sign(target_y - robot->y);
+  const int dx = Sign(target_x - robot->x);
+  const int old_y = robot->y;
+  const int old_x = robot->x;
+  HandleMove(ui, robot->y + dy, robot->x + dx, dx < 0 || (dx == 0 && dy < 0));
+  if (robot->y == old_y && robot->x == old_x) {
+    // Robot touched something: what it was sent to, or an item that has
+    // wandered into its way.
+    ui->walk.timer.enabled = false;
+  } else if (robot->y == target_y && robot->x == target_x &&
+             ++ui->walk.next == finder->path_length) {
+    ui->walk.timer.enabled = false;
+  }
+}
+
+// Updates the game state for one keypress. Returns false if the game should
+// end.
+bool HandleKey(Ui* ui, int ch, uint64_t input_time) {
+  if (ch == 0) {
+    return false;
+  }
+  CountEvent(&g_stats.keypresses);
+  if (ch != KEY_MOUSE && ch != KEY_RESIZE) {
+    ui->walk.timer.enabled = false;
+  }
+
+  int y = ui->game.items[Robot].y;
+  int x = ui->game.items[Robot].x;
+  bool approach_from_right = false;
+
+  switch (ch) {
+    case NetHack_UP_LEFT:
+    case NetHack_up_left:
+    case NumLock_UP_LEFT:
+    case KEY_A1:
+    case KEY_HOME:
+      --y;
+      --x;
+      approach_from_right = true;
+      break;
+    case Emacs_PREVIOUS:
+    case NetHack_UP:
+    case NetHack_up:
+    case NumLock_UP:
+    case KEY_UP:
+      // approach_from_right: special case
+      --y;
+      approach_from_right = true;
+      break;
+    case NetHack_UP_RIGHT:
+    case NetHack_up_right:
+    case NumLock_UP_RIGHT:
+    case KEY_A3:
+    case KEY_PPAGE:
+      --y;
+      ++x;
+      break;
+    case Emacs_BACKWARD:
+    case NetHack_LEFT:
+    case NetHack_left:
+    case NumLock_LEFT:
+    case KEY_LEFT:
+      --x;
+      approach_from_right = true;
+      break;
+    case Emacs_FORWARD:
+    case NetHack_RIGHT:
+    case NetHack_right:
+    case NumLock_RIGHT:
+    case KEY_RIGHT:
+      ++x;
+      approach_from_right = false;
+      break;
+    case NetHack_DOWN_LEFT:
+    case NetHack_down_left:
+    case NumLock_DOWN_LEFT:
+    case KEY_C1:
+    case KEY_END:
+      ++y;
+      --x;
+      approach_from_right = true;
+      break;
+    case Emacs_NEXT:
+    case NetHack_DOWN:
+    case NetHack_down:
+    case NumLock_DOWN:
+    case KEY_DOWN:
+      ++y;
+      break;
+    case NetHack_DOWN_RIGHT:
+    case NetHack_down_right:
+    case NumLock_DOWN_RIGHT:
+    case KEY_C3:
+    case KEY_NPAGE:
+      ++y;
+      ++x;
+      break;
+    case Key_QUIT:
+    case Key_quit:
+      EndGame(ui, ui->round_over ? EXIT_SUCCESS : EXIT_FAILURE);
+      return false;
+    case Key_restart:
+    case Key_RESTART:
+      StartRound(ui, ui->round_over);
+      y = ui->game.items[Robot].y;
+      x = ui->game.items[Robot].x;
+      break;
+    case Key_RedrawScreen:
+      ui->dirty.full = true;
+      break;
+    case Key_minimap:
+    case Key_MINIMAP:
+      ui->minimap.shown = !ui->minimap.shown;
+      BuildLayers(ui);
+      ui->dirty.full = true;
+      break;
+    case Key_hint:
+    case Key_HINT:
+      ShowHint(ui);
+      break;
+    case Key_sonar:
+    case Key_SONAR:
+      PingSonar(ui, ch == Key_SONAR);
+      break;
+    case Key_save:
+    case Key_SAVE:
+      SaveSnapshot(ui);
+      break;
+    case KEY_RESIZE:
+      HandleResize(ui);
+      break;
+    case KEY_MOUSE: {
+      MEVENT event;
+      if (getmouse(&event) == OK &&
+          event.bstate & (BUTTON1_PRESSED | BUTTON1_CLICKED)) {
+        HandleClick(ui, event.y, event.x);
+      }
+      break;
+    }
+    default:
+      ShowMessage(ui,
+                  "Move: direction keys or click. W hint, P sonar, M map, "
+                  "S save, R new, Q quit.");
+      break;
+  }
+
+  HandleMove(ui, y, x, approach_from_right);
+
+  const uint64_t update_time = Now();
+  HistogramRecord(&g_stats.input_to_update, update_time - input_time);
+  if (ui->unpainted_count < COUNT(ui->unpainted)) {
+    ui->unpainted[ui->unpainted_count++] =
+        (UnpaintedKey){.input_time = input_time, .update_time = update_time};
+  }
+  return true;
+}
+
+static void StepAutopilot(Ui* ui) {
+  const Direction d = DecideMove(&ui->autopilot.autopilot, &ui->game);
+  const Item* robot = &ui->game.items[Robot];
+  const int dy = Steps[d].dy;
+  const int dx = Steps[d].dx;
+  HandleMove(ui, robot->y + dy, robot->x + dx, dx < 0 || (dx == 0 && dy < 0));
+}
+
+static void Tick(Ui* ui) {
+  if (ui->round_over) {
+    return;
+  }
+  const uint64_t start = TraceBegin();
+  TickGame(&ui->game);
+  LogEvent((Event){.type = EventTypeTick, .hash = ui->game.hash});
+  DrawItemMoves(ui);
+  DrawSightChanges(ui);
+  TraceEnd(TracePhaseTick, start);
+}
+
+// Returns the number of milliseconds until the next timer is due, or -1 if
+// none is running.
+static int GetTimersTimeout(const Ui* ui) {
+  return GetTimerTimeout(
+      &ui->walk.timer,
+      GetTimerTimeout(&ui->autopilot.timer, GetTimerTimeout(&ui->tick, -1)));
+}
+
+// Runs whatever timers are due. Returns true if any did.
+bool RunTimers(Ui* ui) {
+  bool ran = false;
+  if (TimerIsDue(&ui->tick)) {
+    Tick(ui);
+    ran = true;
+  }
+  if (TimerIsDue(&ui->autopilot.timer)) {
+    StepAutopilot(ui);
+    ran = true;
+  }
+  if (TimerIsDue(&ui->walk.timer)) {
+    StepWalk(ui);
+    ran = true;
+  }
+  return ran;
+}
+
+Input g_input = {.frames_per_second = 60};
+
+static void AddKeySequence(KeySequences* keys, const char* sequence,
+                           int key) {
+  if (sequence == NULL || sequence == (char*)-1 || sequence[0] == '\0' ||
+      keys->count == COUNT(keys->sequences)) {
+    return;
+  }
+  keys->sequences[keys->count++] =
+      (KeySequence){.sequence = sequence, .key = key};
+}
+
+// Learns the escape sequences for the keys MainLoop cares about, from terminfo
+// and from the sequences most terminals send in either cursor key mode.
+void LoadKeySequences(KeySequences* keys) {
+  keys->count = 0;
+  static const struct {
+    const char* capability;
+    int key;
+  } capabilities[] = {
+      {"kcuu1", KEY_UP}, {"kcud1", KEY_DOWN}, {"kcub1", KEY_LEFT},
+      {"kcuf1", KEY_RIGHT}, {"khome", KEY_HOME}, {"kend", KEY_END},
+      {"kpp", KEY_PPAGE}, {"knp", KEY_NPAGE}, {"ka1", KEY_A1},
+      {"ka3", KEY_A3}, {"kc1", KEY_C1}, {"kc3", KEY_C3},
+  };
+  for (size_t i = 0; i < COUNT(capabilities); ++i) {
+    AddKeySequence(keys, tigetstr(capabilities[i].capability),
+                   capabilities[i].key);
+  }
+  static const KeySequence fallbacks[] = {
+      {"\033[A", KEY_UP},    {"\033[B", KEY_DOWN},  {"\033[D", KEY_LEFT},
+      {"\033[C", KEY_RIGHT}, {"\033OA", KEY_UP},    {"\033OB", KEY_DOWN},
+      {"\033OD", KEY_LEFT},  {"\033OC", KEY_RIGHT}, {"\033[H", KEY_HOME},
+      {"\033[F", KEY_END},   {"\033[1~", KEY_HOME}, {"\033[4~", KEY_END},
+      {"\033[5~", KEY_PPAGE}, {"\033[6~", KEY_NPAGE},
+  };
+  for (size_t i = 0; i < COUNT(fallbacks); ++i) {
+    AddKeySequence(keys, fallbacks[i].sequence, fallbacks[i].key);
+  }
+}
+
+// Decodes a mouse report, in which ncurses has asked the terminal to send
+// button presses: either "\033[M" and 3 bytes of button, column, and row,
+// each plus 32, or "\033[<button;column;row" and M (or m, for a release).
+// Rows and columns count from 1. Only presses of the first button are
+// reported as keys.
+static DecodeResult DecodeMouse(const char* buffer, size_t length,
+                                InputEvent* event, size_t* consumed) {
+  int button;
+  if (buffer[2] == 'M') {
+    if (length < 6) {
+      return DecodeResultNeedMore;
+    }
+    button = (unsigned char)buffer[3] - 32;
+    event->x = (unsigned char)buffer[4] - 33;
+    event->y = (unsigned char)buffer[5] - 33;
+    *consumed = 6;
+    // In this encoding, 3 means a release.
+    if (button == 3) {
+      button = -1;
+    }
+  } else {
+    const char* end = memchr(buffer, 'M', length);
+    const char* release = memchr(buffer, 'm', length);
+    if (end == NULL || (release != NULL && release < end)) {
+      end = release;
+    }
+    if (end == NULL) {
+      return DecodeResultNeedMore;
+    }
+    int column = 0;
+    int row = 0;
+    if (sscanf(&buffer[3], "%d;%d;%d", &button, &column, &row) != 3) {
+      button = -1;
+    }
+    event->x = column - 1;
+    event->y = row - 1;
+    *consumed = (size_t)(end - buffer) + 1;
+    if (*end == 'm') {
+      button = -1;
+    }
+  }
+  if (button != 0) {
+    return DecodeResultNone;
+  }
+  event->key = KEY_MOUSE;
+  return DecodeResultKey;
+}
+
+// Decodes the key at the start of `buffer`, from a terminal that sends
+// `keys`. If `buffer` holds only the start of an escape sequence, returns
+// DecodeResultNeedMore unless `flush` is set, in which case the escape is
+// returned as a plain key.
+DecodeResult DecodeKey(const KeySequences* keys, const char* buffer,
+                       size_t length, bool flush, InputEvent* event,
+                       size_t* consumed) {
+  event->key = (unsigned char)buffer[0];
+  *consumed = 1;
+  if (buffer[0] != '\033') {
+    return DecodeResultKey;
+  }
+  if (length >= 3 && buffer[1] == '[' &&
+      (buffer[2] == 'M' || buffer[2] == '<')) {
+    const DecodeResult result = DecodeMouse(buffer, length, event, consumed);
+    if (result != DecodeResultNeedMore || !flush) {
+      return result;
+    }
+  }
+  bool partial = false;
+  for (size_t i = 0; i < keys->count; ++i) {
+    const KeySequence* s = &keys->sequences[i];
+    const size_t n = strlen(s->sequence);
+    if (length >= n && memcmp(buffer, s->sequence, n) == 0) {
+      if (n > *consumed) {
+        event->key = s->key;
+        *consumed = n;
+      }
+    } else if (length < n && memcmp(buffer, s->sequence, length) == 0) {
+      partial = true;
+    }
+  }
+  return partial && *consumed == 1 && !flush ? DecodeResultNeedMore
+                                             : DecodeResultKey;
+}
+
+static void PushInput(InputEvent event) {
+  const uint64_t head =
+      atomic_load_explicit(&g_input.head, memory_order_relaxed);
+  // Never drop input: if the main thread has fallen a whole queue behind,
+  // wait for it.
+  while (head - atomic_load_explicit(&g_input.tail, memory_order_acquire) ==
+         InputQueueCapacity) {
+    const struct timespec pause = {.tv_nsec = 1000 * 1000};
+    nanosleep(&pause, NULL);
+  }
+  event.time = Now();
+  g_input.events[head % InputQueueCapacity] = event;
+  atomic_store_explicit(&g_input.head, head + 1, memory_order_release);
+}
+
+static bool PopInput(InputEvent* event) {
+  const uint64_t tail =
+      atomic_load_explicit(&g_input.tail, memory_order_relaxed);
+  if (tail == atomic_load_explicit(&g_input.head, memory_order_acquire)) {
+    return false;
+  }
+  *event = g_input.events[tail % InputQueueCapacity];
+  atomic_store_explicit(&g_input.tail, tail + 1, memory_order_release);
+  return true;
+}
+
+void HandleWindowChange(int signal) {
+  (void)signal;
+  const int saved = errno;
+  const char byte = 0;
+  write(g_input.resize[1], &byte, 1);
+  errno = saved;
+}
+
+static void* RunInputReader(void* unused) {
+  (void)unused;
+  char buffer[64];
+  size_t length = 0;
+  while (true) {
+    struct pollfd fds[] = {
+        {.fd = STDIN_FILENO, .events = POLLIN},
+        {.fd = g_input.resize[0], .events = POLLIN},
+    };
+    const int ready =
+        poll(fds, COUNT(fds), length > 0 ? EscapeTimeoutMilliseconds : -1);
+    if (ready < 0 && errno == EINTR) {
+      continue;
+    }
+    if (ready < 0) {
+      // Nothing will come of polling again. 0 tells MainLoop to stop.
+      PushInput((InputEvent){.key = 0});
+      write(g_input.doorbell[1], "", 1);
+      return NULL;
+    }
+    bool pushed = false;
+    if (fds[1].revents & POLLIN) {
+      char drain[16];
+      read(g_input.resize[0], drain, sizeof(drain));
+      PushInput((InputEvent){.key = KEY_RESIZE});
+      pushed = true;
+    }
+    if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+      const ssize_t n =
+          read(STDIN_FILENO, &buffer[length], sizeof(buffer) - length);
+      if (n <= 0) {
+        // The terminal went away. 0 tells MainLoop to stop.
+        PushInput((InputEvent){.key = 0});
+        write(g_input.doorbell[1], "", 1);
+        return NULL;
+      }
+      length += (size_t)n;
+    }
+    // An escape sequence that has not completed by now never will.
+    const bool flush = ready == 0 || length == sizeof(buffer);
+    while (length > 0) {
+      InputEvent event = {0};
+      size_t consumed;
+      const DecodeResult result =
+          DecodeKey(&g_input.keys, buffer, length, flush, &event, &consumed);
+      if (result == DecodeResultNeedMore) {
+        break;
+      }
+      if (result == DecodeResultKey) {
+        PushInput(event);
+        pushed = true;
+      }
+      length -= consumed;
+      memmove(buffer, &buffer[consumed], length);
+    }
+    if (pushed) {
+      write(g_input.doorbell[1], "", 1);
+    }
+  }
+}
+
+static void StartInputThread(void) {
+  LoadKeySequences(&g_input.keys);
+  if (pipe(g_input.doorbell) != 0 || pipe(g_input.resize) != 0) {
+    endwin();
+    perror("pipe");
+    exit(EXIT_FAILURE);
+  }
+  // This replaces curses' own handler, which only tells getch, and getch
+  // does not run here: the main loop resizes the screen itself when the
+  // reader passes KEY_RESIZE on.
+  CatchSignal(SIGWINCH, HandleWindowChange);
+  if (StartThread(&g_input.reader, RunInputReader) != 0) {
+    endwin();
+    fprintf(stderr, "Could not start the input thread!\n");
+    exit(EXIT_FAILURE);
+  }
+}
+
+// Tells curses about the terminal's new size. (getch does this for itself.)
+void UpdateTerminalSize(void) {
+  struct winsize size;
+  if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0) {
+    resizeterm(size.ws_row, size.ws_col);
+  }
+}
+
+// Waits until the input thread rings the doorbell, or until `timeout`
+// milliseconds have passed (forever, if it is negative).
+static void WaitForInput(int timeout) {
+  struct pollfd doorbell = {.fd = g_input.doorbell[0], .events = POLLIN};
+  if (poll(&doorbell, 1, timeout) > 0) {
+    char drain[64];
+    read(g_input.doorbell[0], drain, sizeof(drain));
+  }
+}
+
+static void RunThreadedMainLoop(Ui* ui) {
+  StartInputThread();
+  const uint64_t frame_interval = 1000000000 / g_input.frames_per_second;
+  uint64_t next_frame = 0;
+  bool pending = false;
+  while (true) {
+    int timeout = GetTimersTimeout(ui);
+    if (pending) {
+      const uint64_t now = Now();
+      // Rounded up, since a wait of 0 would poll until the frame is due.
+      const int frame_timeout =
+          now >= next_frame ? 0 : (int)((next_frame - now + 999999) / 1000000);
+      if (timeout < 0 || frame_timeout < timeout) {
+        timeout = frame_timeout;
+      }
+    }
+    HandleSignals();
+    const uint64_t read_start = TraceBegin();
+    WaitForInput(timeout);
+    TraceEnd(TracePhaseInput, read_start);
+
+    InputEvent event;
+    while (PopInput(&event)) {
+      if (event.key == KEY_RESIZE) {
+        UpdateTerminalSize();
+      }
+      // getmouse cannot see clicks the input thread has read.
+      if (event.key == KEY_MOUSE) {
+        HandleClick(ui, event.y, event.x);
+        pending = true;
+        continue;
+      }
+      if (!HandleKey(ui, event.key, event.time)) {
+        return;
+      }
+      pending = true;
+    }
+    if (RunTimers(ui)) {
+      pending = true;
+    }
+    if (pending && Now() >= next_frame) {
+      Render(ui);
+      pending = false;
+      next_frame = Now() + frame_interval;
+    }
+  }
+}
+
+void MainLoop(Ui* ui) {
+  // Report button presses at once, rather than waiting to see whether they
+  // turn into clicks.
+  mousemask(BUTTON1_PRESSED | BUTTON1_CLICKED, NULL);
+  mouseinterval(0);
+  if (g_input.enabled) {
+    RunThreadedMainLoop(ui);
+    return;
+  }
+  while (true) {
+    HandleSignals();
+    timeout(GetTimersTimeout(ui));
+    const uint64_t read_start = TraceBegin();
+    const int ch = getch();
+    TraceEnd(TracePhaseInput, read_start);
+    if (ch == ERR) {
+      // A timer is due, or a signal came in.
+    } else if (!HandleKey(ui, ch, Now())) {
+      break;
+    }
+    RunTimers(ui);
+    Render(ui);
+  }
+}
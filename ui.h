@@ -0,0 +1,265 @@
+// The curses interface: drawing the field from its layers, the header and
+// the minimap; handling keys and clicks; the timers that drive the
+// autopilot and the ticks; decoding input; and the main loop. --publish is
+// here too, since it copies the game out on every paint.
+//
+// This program is free software; you can redistribute it and/or modify it under
+// the terms of the GNU General Public License as published by the Free Software
+// Foundation; either version 2 of the License, or (at your option) any later
+// version.
+
+#ifndef UI_H
+#define UI_H
+
+#include <ncurses.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdnoreturn.h>
+
+#include "autopilot.h"
+#include "game.h"
+
+static const int HeaderSize = 1;
+
+// Things that happen on their own, independent of keypresses, are driven by
+// timers. The main loop waits for input no longer than until the next timer
+// is due.
+typedef struct Timer {
+  bool enabled;
+  uint64_t interval;
+  uint64_t next;
+} Timer;
+
+// The part of the field on the screen, below the header. A field larger than
+// the screen scrolls to keep Robot in view.
+typedef struct View {
+  int y;
+  int x;
+  int height;
+  int width;
+} View;
+
+// A run of field cells on one row that must be recomposited from the layers.
+// Spans always cover whole icons, so a wide character is never split.
+typedef struct DirtySpan {
+  int y;
+  int x;
+  int width;
+} DirtySpan;
+
+// What Render needs to repaint: just the header line, some spans of the
+// field, the whole composited frame, or the whole terminal.
+typedef struct Dirty {
+  bool header;
+  bool frame;
+  bool full;
+  size_t span_count;
+  DirtySpan spans[64];
+} Dirty;
+
+// The minimap, which the M key shows and hides, is a panel at the right of
+// the screen with an overview of the whole field in braille. A dot is raised
+// if the part of the field it stands for has items Robot has not touched,
+// and a character is bold until Robot has been in its part. With --fog,
+// which hides the items Robot cannot see, a dot is raised instead if Robot
+// has been in its part. Robot's own character is in reverse video. Each
+// dot stands for 2 * scale × scale blocks, which is about square on the
+// screen, and keeps the sums of their summaries, which the moves, touches,
+// and ticks that change them adjust as they happen; only the characters
+// whose dots changed are redrawn.
+typedef struct Minimap {
+  bool shown;
+  // Without braille, a character is one of " .:#", by how many of its dots
+  // are raised.
+  bool braille;
+  int scale;
+  int rows;
+  int columns;
+  // The screen column of the panel, which is right of a separator line.
+  int left;
+  // Per dot: there are rows * 4 of columns * 2 of them.
+  uint32_t* untouched;
+  uint32_t* visits;
+  // The characters to redraw, and whether each is in the list.
+  uint32_t* changes;
+  size_t change_count;
+  bool* changed;
+} Minimap;
+
+// Keys that have been handled but whose effects are not yet on the screen,
+// kept for the latency statistics.
+typedef struct UnpaintedKey {
+  uint64_t input_time;
+  uint64_t update_time;
+} UnpaintedKey;
+
+// A game on a terminal, and everything about how it is shown there. The UI
+// functions all take the one they work on. The terminal the program was
+// started on has g_ui; with --serve, each session has its own.
+typedef struct Ui {
+  Game game;
+  bool has_colors;
+  View view;
+
+  // The screen is composited from off-screen layers. The frame and the items
+  // other than Robot change rarely, so we draw the part of them that is in
+  // view into view-sized pads, and redraw them only when the view scrolls or
+  // an item moves. Each frame then copies the pads onto stdscr below the
+  // header and draws the dynamic layer (the header message and Robot) on
+  // top. refresh sends only the cells that actually changed.
+  WINDOW* frame_layer;
+  WINDOW* item_layer;
+  const char* message;
+  Dirty dirty;
+  Minimap minimap;
+
+  // The distance from Kitten at the last hint, for ShowHint, and the text of
+  // the last sonar ping, for PingSonar.
+  uint32_t last_hint;
+  char sonar_message[96];
+
+  // With --autopilot, Robot moves by itself. Keys still work, so you can
+  // quit, or help.
+  struct {
+    Autopilot autopilot;
+    Timer timer;
+  } autopilot;
+
+  // With --tick-rate, the non-kitten items wander around by themselves. With
+  // --hard, Kitten runs from Robot on the same ticks.
+  Timer tick;
+
+  // Clicking on the field sends Robot walking there, a step at a time, along
+  // the path FindPath found. Any key stops it.
+  struct {
+    Timer timer;
+    // The index in game.paths.path of the jump point Robot is heading for.
+    size_t next;
+  } walk;
+
+  // Once Robot has found Kitten, the round is over, and Robot stays put until
+  // the next round. With --serve, the game can also be over without the
+  // program ending; see EndGame.
+  bool round_over;
+  bool game_over;
+
+  UnpaintedKey unpainted[256];
+  size_t unpainted_count;
+} Ui;
+
+// With --publish, the game shows itself to spectators, who run --watch,
+// through a POSIX shared memory object: each time a frame is painted, what it
+// shows goes into the object. The player's process does the same work however
+// many are watching, and never hears from them. The object is a seqlock: the
+// player makes `sequence` odd while it writes and even again after, and a
+// spectator keeps what it read only if `sequence` was even, and the same,
+// before and after.
+enum { BroadcastMagic = 0x6b667272, BroadcastVersion = 1 };
+
+typedef struct Broadcast {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t item_capacity;
+  _Atomic uint64_t sequence;
+  int32_t width;
+  int32_t height;
+  uint32_t border_color;
+  int32_t fog_radius;
+  uint64_t item_count;
+  char message[256];
+  Item items[];
+} Broadcast;
+
+// Ticks per second with --hard but no --tick-rate.
+static const uint64_t HardTickRate = 4;
+
+// With --input-thread, a separate thread reads and decodes keys and passes
+// them to the main thread through a lock-free single-producer,
+// single-consumer queue. The main thread handles every key as soon as it
+// arrives, but paints at most once per frame interval, so a slow terminal
+// delays the picture but never the input. ncurses is not thread-safe, so the
+// input thread reads the terminal directly and decodes escape sequences itself
+// rather than calling getch.
+typedef struct InputEvent {
+  int key;
+  uint64_t time;
+  // For KEY_MOUSE, where the button was pressed.
+  int y;
+  int x;
+} InputEvent;
+
+typedef struct KeySequence {
+  const char* sequence;
+  int key;
+} KeySequence;
+
+// The escape sequences a terminal sends for the keys MainLoop cares about.
+// They point into the terminal's description.
+typedef struct KeySequences {
+  KeySequence sequences[32];
+  size_t count;
+} KeySequences;
+
+enum { InputQueueCapacity = 1 << 10 };
+static const int EscapeTimeoutMilliseconds = 50;
+
+typedef struct Input {
+  bool enabled;
+  unsigned int frames_per_second;
+  pthread_t reader;
+  // The input thread writes a byte to doorbell[1] after queueing keys, and
+  // the window size change handler writes to resize[1].
+  int doorbell[2];
+  int resize[2];
+  KeySequences keys;
+  // Written only by the input thread:
+  _Atomic uint64_t head;
+  // Written only by the main thread:
+  _Atomic uint64_t tail;
+  InputEvent events[InputQueueCapacity];
+} Input;
+
+typedef enum DecodeResult {
+  DecodeResultKey,
+  DecodeResultNeedMore,
+  // Input the game does not care about, such as mouse movement.
+  DecodeResultNone,
+} DecodeResult;
+
+extern Ui g_ui;
+extern bool g_fixed_size;
+extern bool g_serving;
+extern const char* g_save_path;
+extern int g_sonar_radius;
+extern size_t g_growth;
+extern Input g_input;
+
+noreturn void Finish(int signal);
+void CatchFinishSignals(void);
+void HandleSignals(void);
+void ConfigureScreen(Ui* ui);
+void InitializeScreen(Ui* ui);
+bool StartPublishing(const char* name, size_t item_capacity);
+void DrawLayers(Ui* ui);
+bool FollowRobot(Ui* ui);
+void FreeMinimap(Minimap* minimap);
+void BuildLayers(Ui* ui);
+void RedrawScreen(Ui* ui);
+void HandleResize(Ui* ui);
+void ShowIntroduction(Ui* ui);
+int GetTimerTimeout(const Timer* timer, int timeout);
+void Render(Ui* ui);
+void LogStart(const Game* game);
+void HandleClick(Ui* ui, int y, int x);
+bool HandleKey(Ui* ui, int ch, uint64_t input_time);
+bool RunTimers(Ui* ui);
+void LoadKeySequences(KeySequences* keys);
+DecodeResult DecodeKey(const KeySequences* keys, const char* buffer,
+                       size_t length, bool flush, InputEvent* event,
+                       size_t* consumed);
+void HandleWindowChange(int signal);
+void UpdateTerminalSize(void);
+void MainLoop(Ui* ui);
+
+#endif  // UI_H